@@ -1,4 +1,13 @@
-import { createCanvas, Image } from "../mod.ts";
+import {
+  Canvas,
+  CommandBuffer,
+  createCanvas,
+  Fonts,
+  Image,
+  Op,
+  PictureRecorder,
+  RenderPool,
+} from "../mod.ts";
 import {
   createCanvas as createCanvasWasm,
   loadImage,
@@ -50,3 +59,295 @@ Deno.bench("images: deno canvaskit-wasm", async () => {
   drawImage(ctx, skiaImage, testImage);
   canvas.toBuffer("image/png");
 });
+
+function drawHouses(batching) {
+  const canvas = createCanvas(1024, 768);
+  const ctx = canvas.getContext("2d");
+  ctx.batching = batching;
+  for (let i = 0; i < 1000; i++) {
+    draw(ctx);
+  }
+  canvas.readPixels(0, 0, 1, 1);
+}
+
+Deno.bench(
+  "batching: per-call",
+  { group: "batching", baseline: true },
+  () => drawHouses(false),
+);
+
+Deno.bench(
+  "batching: command buffer",
+  { group: "batching" },
+  () => drawHouses(true),
+);
+
+Deno.bench("path: 100k segments, transform every 10", () => {
+  const canvas = createCanvas(512, 512);
+  const ctx = canvas.getContext("2d");
+  ctx.beginPath();
+  ctx.moveTo(0, 0);
+  for (let i = 0; i < 100_000; i++) {
+    if (i % 10 === 0) ctx.rotate(0.001);
+    ctx.lineTo(i % 512, (i * 7) % 512);
+  }
+  ctx.stroke();
+  canvas.readPixels(0, 0, 1, 1);
+});
+
+Deno.bench("path: 50k circles in one path", () => {
+  const canvas = createCanvas(512, 512);
+  const ctx = canvas.getContext("2d");
+  ctx.beginPath();
+  for (let i = 0; i < 50_000; i++) {
+    const x = (i * 13) % 512;
+    const y = (i * 29) % 512;
+    ctx.moveTo(x + 2, y);
+    ctx.arc(x, y, 2, 0, Math.PI * 2);
+  }
+  ctx.fill();
+  canvas.readPixels(0, 0, 1, 1);
+});
+
+Deno.bench("state: 1M save/restore pairs", () => {
+  const canvas = createCanvas(16, 16);
+  const ctx = canvas.getContext("2d");
+  ctx.setLineDash([2, 2]);
+  ctx.font = "12px sans-serif";
+  for (let i = 0; i < 1_000_000; i++) {
+    ctx.save();
+    ctx.translate(1, 1);
+    ctx.restore();
+  }
+  canvas.readPixels(0, 0, 1, 1);
+});
+
+function fillShortText(cached) {
+  const budget = Fonts.textCacheBudget;
+  Fonts.textCacheBudget = cached ? budget : 0;
+  const canvas = createCanvas(256, 64);
+  const ctx = canvas.getContext("2d");
+  ctx.font = "12px sans-serif";
+  for (let i = 0; i < 1000; i++) {
+    ctx.fillText(`${i % 100}`, 10, 32);
+  }
+  canvas.readPixels(0, 0, 1, 1);
+  Fonts.textCacheBudget = budget;
+}
+
+Deno.bench(
+  "text: 1000 short labels, uncached",
+  { group: "text" },
+  () => fillShortText(false),
+);
+
+Deno.bench(
+  "text: 1000 short labels, cached",
+  { group: "text" },
+  () => fillShortText(true),
+);
+
+Deno.bench("text: 100k labels", () => {
+  const canvas = createCanvas(512, 512);
+  const ctx = canvas.getContext("2d");
+  ctx.font = "11px sans-serif";
+  for (let i = 0; i < 100_000; i++) {
+    ctx.fillText(`Label ${i}`, (i * 37) % 512, (i * 53) % 512);
+  }
+  canvas.readPixels(0, 0, 1, 1);
+});
+
+const TICKS = Array.from({ length: 500 }, (_, i) => `${(i * 0.25).toFixed(2)}`);
+
+Deno.bench("measureText: 500 ticks, one call each", { group: "measure" }, () => {
+  const ctx = createCanvas(16, 16).getContext("2d");
+  for (const tick of TICKS) ctx.measureText(tick);
+});
+
+Deno.bench("measureText: 500 ticks, batched", { group: "measure" }, () => {
+  const ctx = createCanvas(16, 16).getContext("2d");
+  ctx.measureTextBatch(TICKS);
+});
+
+const MOD_URL = new URL("../mod.ts", import.meta.url).href;
+
+async function startup(env) {
+  const { success } = await new Deno.Command(Deno.execPath(), {
+    args: ["eval", "--unstable-ffi", "-A", `await import("${MOD_URL}")`],
+    env,
+  }).output();
+  if (!success) throw new Error("startup failed");
+}
+
+Deno.bench(
+  "startup: eager system fonts",
+  { group: "startup", baseline: true },
+  () => startup({ CANVAS_LAZY_SYSTEM_FONTS: "0" }),
+);
+
+Deno.bench(
+  "startup: lazy system font index",
+  { group: "startup" },
+  () => startup({ CANVAS_LAZY_SYSTEM_FONTS: "1" }),
+);
+
+// A bar chart with labels as a command stream, rendered 64 times per run
+const CHART = (() => {
+  const cmd = new CommandBuffer();
+  cmd.pushString(Op.SetFillStyle, "white");
+  cmd.push4(Op.FillRect, 0, 0, 512, 512);
+  cmd.pushFont(11, "sans-serif", 400, 0, 0, 5);
+  for (let i = 0; i < 200; i++) {
+    cmd.pushString(Op.SetFillStyle, `hsl(${i * 7}, 60%, 50%)`);
+    cmd.push4(Op.FillRect, 10 + (i % 40) * 12, 20 + (i >> 3), 10, 300);
+    cmd.pushText(Op.FillText, `${i}`, 10 + (i % 40) * 12, 500, 100_000);
+  }
+  return cmd.take();
+})();
+
+// Each run starts its pool outside of the timed section and closes it
+// afterwards, so no pool threads outlive the bench
+for (const threads of new Set([1, 2, 4, navigator.hardwareConcurrency])) {
+  Deno.bench(
+    `render pool: 64 charts, ${threads} thread(s)`,
+    { group: "render pool", baseline: threads === 1, n: 20, warmup: 2 },
+    async (b) => {
+      const pool = new RenderPool(threads);
+      b.start();
+      await Promise.all(
+        Array.from({ length: 64 }, () => pool.render(512, 512, CHART)),
+      );
+      b.end();
+      await pool.close();
+    },
+  );
+}
+
+// A poster recorded once, rasterized at 16k x 16k (1 GiB of pixels). Both
+// are created on first use, so that other benches don't pay for them.
+let poster;
+function posterSetup() {
+  poster ??= {
+    picture: recordPoster(),
+    canvas: new Canvas(16384, 16384),
+  };
+  return poster;
+}
+
+function recordPoster() {
+  const recorder = new PictureRecorder(1024, 1024);
+  const ctx = recorder.getContext("2d");
+  ctx.font = "12px sans-serif";
+  for (let i = 0; i < 2000; i++) {
+    ctx.fillStyle = `hsl(${i % 360}, 70%, 50%)`;
+    ctx.beginPath();
+    ctx.arc((i * 37) % 1024, (i * 53) % 1024, 8 + (i % 40), 0, Math.PI * 2);
+    ctx.fill();
+    ctx.fillText(`Item ${i}`, (i * 71) % 1024, (i * 29) % 1024);
+  }
+  return recorder.finish();
+}
+
+Deno.bench(
+  "poster 16k: single thread",
+  { group: "tiled", baseline: true, n: 3, warmup: 1 },
+  (b) => {
+    const { picture, canvas } = posterSetup();
+    b.start();
+    canvas.getContext("2d").drawPicture(picture, 0, 0, 16384, 16384);
+    b.end();
+  },
+);
+
+Deno.bench(
+  "poster 16k: tiled",
+  { group: "tiled", n: 3, warmup: 1 },
+  (b) => {
+    const { picture, canvas } = posterSetup();
+    b.start();
+    canvas.drawPictureTiled(picture);
+    b.end();
+  },
+);
+
+const UHD = createCanvas(3840, 2160);
+UHD.getContext("2d").scale(3.75, 2.8125);
+draw(UHD.getContext("2d"));
+// UHD is encoded over and over unchanged, measure the encoders rather than
+// the encode cache
+Canvas.encodeCacheEnabled = false;
+
+Deno.bench(
+  "4k PNG: Skia encoder",
+  { group: "png", baseline: true, n: 10 },
+  () => {
+    Canvas.pngEncoderThreads = 1;
+    UHD.encode("png");
+    Canvas.pngEncoderThreads = 0;
+  },
+);
+
+Deno.bench(
+  "4k PNG: parallel encoder",
+  { group: "png", n: 10 },
+  () => {
+    UHD.encode("png");
+  },
+);
+
+Deno.bench(
+  "4k PNG: time to first byte, encode()",
+  { group: "ttfb", baseline: true },
+  () => {
+    UHD.encode("png");
+  },
+);
+
+Deno.bench(
+  "4k PNG: time to first byte, encodeStream()",
+  { group: "ttfb" },
+  async () => {
+    const reader = UHD.encodeStream("png").getReader();
+    await reader.read();
+    await reader.cancel();
+  },
+);
+
+const FRAME = createCanvas(1920, 1080);
+draw(FRAME.getContext("2d"));
+
+Deno.bench(
+  "1080p invert: getImageData/putImageData",
+  { group: "pixels", baseline: true },
+  () => {
+    const ctx = FRAME.getContext("2d");
+    const image = ctx.getImageData(0, 0, 1920, 1080);
+    const data = image.data;
+    for (let i = 0; i < data.length; i += 4) {
+      data[i] = 255 - data[i];
+      data[i + 1] = 255 - data[i + 1];
+      data[i + 2] = 255 - data[i + 2];
+    }
+    ctx.putImageData(image, 0, 0);
+  },
+);
+
+Deno.bench(
+  "1080p invert: lockPixels",
+  { group: "pixels" },
+  () => {
+    // Premultiplied, so each channel is inverted against alpha
+    const pixels = FRAME.lockPixels();
+    const { data, rowBytes } = pixels;
+    for (let y = 0; y < 1080; y++) {
+      const end = y * rowBytes + 1920 * 4;
+      for (let i = y * rowBytes; i < end; i += 4) {
+        const a = data[i + 3];
+        data[i] = a - data[i];
+        data[i + 1] = a - data[i + 1];
+        data[i + 2] = a - data[i + 2];
+      }
+    }
+    pixels.unlock();
+  },
+);
@@ -0,0 +1,48 @@
+// Encode time and size for each encoder setting, on the chart test image
+// tiled to 1600x1200:
+//
+//   deno run -A --unstable-ffi bench/encode_options.js
+import { Canvas, Image } from "../mod.ts";
+
+const chart = new Image(
+  Deno.readFileSync(new URL("../testdata/chart.png", import.meta.url)),
+);
+const canvas = new Canvas(1600, 1200);
+const ctx = canvas.getContext("2d");
+for (const [x, y] of [[0, 0], [800, 0], [0, 600], [800, 600]]) {
+  ctx.drawImage(chart, x, y);
+}
+
+const settings = [
+  ["png", {}],
+  ["png", { compressionLevel: 1 }],
+  ["png", { compressionLevel: 9 }],
+  ["png", { filters: ["none"] }],
+  ["png", { filters: ["sub"] }],
+  ["png", { filters: ["paeth"] }],
+  ["png", { compressionLevel: 1, filters: ["none"] }],
+  ["jpeg", { quality: 90 }],
+  ["jpeg", { quality: 90, chromaSubsampling: "4:2:2" }],
+  ["jpeg", { quality: 90, chromaSubsampling: "4:4:4" }],
+  ["webp", { quality: 90 }],
+  ["webp", { lossless: true, effort: 0 }],
+  ["webp", { lossless: true }],
+  ["webp", { lossless: true, effort: 100 }],
+];
+
+// The same canvas is encoded RUNS times with each setting
+Canvas.encodeCacheEnabled = false;
+const RUNS = 5;
+const rows = [];
+for (const [format, options] of settings) {
+  let size = 0;
+  const start = performance.now();
+  for (let i = 0; i < RUNS; i++) size = canvas.encode(format, options).length;
+  rows.push({
+    format,
+    options: JSON.stringify(options),
+    "time (ms)": ((performance.now() - start) / RUNS).toFixed(1),
+    "size (KiB)": (size / 1024).toFixed(1),
+  });
+}
+console.table(rows);
@@ -0,0 +1,35 @@
+// Peak resident memory of encoding a 4k PNG with each API (Linux only):
+//
+//   deno run -A --unstable-ffi bench/encode_rss.js encode|save|stream
+import { createCanvas } from "../mod.ts";
+import { draw } from "./draw.mjs";
+
+const mode = Deno.args[0] ?? "stream";
+const canvas = createCanvas(3840, 2160);
+const ctx = canvas.getContext("2d");
+ctx.scale(3.75, 2.8125);
+draw(ctx);
+
+function peakRss() {
+  const status = Deno.readTextFileSync("/proc/self/status");
+  return status.match(/VmHWM:\s+(\d+) kB/)[1] / 1024;
+}
+
+const before = peakRss();
+const start = performance.now();
+let firstByte;
+if (mode === "encode") {
+  canvas.encode("png");
+  firstByte = performance.now();
+} else if (mode === "save") {
+  canvas.save(Deno.makeTempFileSync({ suffix: ".png" }));
+  firstByte = performance.now();
+} else {
+  for await (const _ of canvas.encodeStream("png")) {
+    firstByte ??= performance.now();
+  }
+}
+console.log(
+  `${mode}: first byte after ${(firstByte - start).toFixed(1)} ms, ` +
+    `peak RSS ${before.toFixed(1)} -> ${peakRss().toFixed(1)} MiB`,
+);
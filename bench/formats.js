@@ -0,0 +1,44 @@
+// Memory, drawing and encoding time of canvases in each pixel format:
+//
+//   deno run -A --unstable-ffi bench/formats.js
+import { Canvas } from "../mod.ts";
+import { draw } from "./draw.mjs";
+
+const SIZE = 2048;
+const RUNS = 5;
+// Encoding is timed RUNS times on the same content
+Canvas.encodeCacheEnabled = false;
+
+function time(fn) {
+  const start = performance.now();
+  for (let i = 0; i < RUNS; i++) fn();
+  return ((performance.now() - start) / RUNS).toFixed(1);
+}
+
+const rows = [];
+for (
+  const colorType of [
+    undefined,
+    "alpha8",
+    "rgb565",
+    "rgb888x",
+    "rgbaF16",
+  ]
+) {
+  const canvas = new Canvas(SIZE, SIZE, { colorType });
+  const ctx = canvas.getContext("2d");
+  ctx.scale(SIZE / 200, SIZE / 200);
+  const pixels = canvas.lockPixels("read");
+  const bytes = pixels.rowBytes * pixels.height;
+  pixels.unlock();
+  rows.push({
+    format: canvas.colorType + (colorType === undefined ? " (default)" : ""),
+    "pixels (MiB)": (bytes / 1024 / 1024).toFixed(1),
+    "draw (ms)": time(() => {
+      draw(ctx);
+      canvas.flush();
+    }),
+    "PNG (ms)": time(() => canvas.encode("png", { compressionLevel: 1 })),
+  });
+}
+console.table(rows);
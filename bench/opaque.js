@@ -0,0 +1,44 @@
+// Blending throughput and encoded size of opaque ({ alpha: false }) and
+// transparent canvases with the same content:
+//
+//   deno run -A --unstable-ffi bench/opaque.js
+import { Canvas, Image } from "../mod.ts";
+
+const SIZE = 1024;
+const RUNS = 20;
+const logo = new Image(
+  Deno.readFileSync(new URL("../testdata/skia_logo.png", import.meta.url)),
+);
+
+function blend(ctx) {
+  ctx.globalAlpha = 0.5;
+  for (let i = 0; i < 200; i++) {
+    ctx.fillStyle = `hsla(${i % 360}, 80%, 50%, 0.6)`;
+    ctx.fillRect((i * 37) % SIZE, (i * 53) % SIZE, 300, 200);
+    ctx.drawImage(logo, (i * 71) % SIZE, (i * 29) % SIZE);
+  }
+  ctx.globalAlpha = 1;
+}
+
+const rows = [];
+for (const alpha of [true, false]) {
+  const canvas = new Canvas(SIZE, SIZE);
+  const ctx = canvas.getContext("2d", { alpha });
+  // Same starting content on both
+  ctx.fillStyle = "black";
+  ctx.fillRect(0, 0, SIZE, SIZE);
+  const start = performance.now();
+  for (let i = 0; i < RUNS; i++) {
+    blend(ctx);
+    canvas.flush();
+  }
+  const ms = (performance.now() - start) / RUNS;
+  rows.push({
+    canvas: alpha ? "transparent" : "opaque",
+    "blend (ms/frame)": ms.toFixed(2),
+    "PNG (KiB)": (canvas.encode("png").length / 1024).toFixed(1),
+    "WebP lossless (KiB)": (canvas.encode("webp").length / 1024).toFixed(1),
+    "WebP q80 (KiB)": (canvas.encode("webp", 80).length / 1024).toFixed(1),
+  });
+}
+console.table(rows);
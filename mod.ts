@@ -9,3 +9,6 @@ export * from "./src/gradient.ts";
 export * from "./src/pattern.ts";
 export * from "./src/pdfdocument.ts";
 export * from "./src/svgcanvas.ts";
+export * from "./src/renderpool.ts";
+export * from "./src/recorder.ts";
+export * from "./src/mapping.ts";
@@ -4,60 +4,133 @@
 #include "include/core/SkCanvas.h"
 #include "include/core/SkSurface.h"
 #include "include/core/SkData.h"
+#include "include/core/SkPath.h"
+#include "include/core/SkPaint.h"
+#include "include/core/SkPathEffect.h"
+#include "include/core/SkPicture.h"
 #include "include/core/SkImageFilter.h"
 #include "include/common.hpp"
 #include "include/effects/SkImageFilters.h"
 #define SK_GL
 #include "include/gpu/GrDirectContext.h"
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace skia::textlayout {
+  class ParagraphBuilder;
+}
 
 typedef enum sk_canvas_backend {
   kBackendCPU,
   kBackendOpenGL,
 } sk_canvas_backend;
 
+// Encoder settings passed from JS as 32-bit ints. -1 keeps the default of
+// SkImage::encodeToData for the format.
+typedef struct sk_encode_options {
+  int format;
+  int quality;
+  // PNG zlib level, 0-9
+  int zlibLevel;
+  // PNG filters to choose from, SkPngEncoder::FilterFlag bits
+  int filters;
+  // WebP compression, lossless by default only at quality 100
+  int lossless;
+  // WebP lossless effort, 0-100
+  int effort;
+  // JPEG chroma subsampling, SkJpegEncoder::Downsample
+  int downsample;
+} sk_encode_options;
+
+// Most encoded images kept per canvas, see sk_canvas_encode_image_ex
+#define ENCODE_CACHE_ENTRIES 4
+
+typedef struct sk_encoded_image {
+  sk_encode_options options;
+  // sk_png_get_threads() when encoded, the parallel encoder's output differs
+  int pngThreads;
+  sk_sp<SkData> data;
+} sk_encoded_image;
+
 typedef struct sk_canvas {
   SkSurface* surface;
   GrDirectContext* context;
   void* context_2d;
   sk_canvas_backend backend;
+  // Images encoded from the surface content with this generation ID
+  uint32_t encodeCacheGeneration = 0;
+  std::vector<sk_encoded_image> encodeCache;
+  uint64_t encodeCacheHits = 0;
+  uint64_t encodeCacheMisses = 0;
+  // Set while JS has access to the pixels, see sk_canvas_lock_pixels
+  bool pixelsLocked = false;
+  // Drawing into pixels owned by JS, see sk_canvas_create_direct
+  bool direct = false;
 } sk_canvas;
 
 typedef struct sk_context_state {
-  SkPaint* paint;
+  SkPaint paint;
   float shadowOffsetX;
   float shadowOffsetY;
   float shadowBlur;
-  std::vector<float> lineDash;
+  // Replaced, never mutated, so saved states can share it
+  std::shared_ptr<const std::vector<float>> lineDash;
   float globalAlpha;
   float lineDashOffset;
   Style fillStyle;
   Style strokeStyle;
   RGBA shadowColor;
-  SkMatrix* transform;
+  SkMatrix transform;
   bool imageSmoothingEnabled;
   FilterQuality imageSmoothingQuality;
   TextAlign textAlign;
   TextBaseline textBaseline;
   TextDirection direction;
-  Font* font;
+  Font font;
   sk_sp<SkImageFilter> filter;
   float letterSpacing;
   float wordSpacing;
+  // Built from lineDash/lineDashOffset when they are set
+  sk_sp<SkPathEffect> dashEffect;
 } sk_context_state;
 
 typedef struct sk_context {
   SkCanvas* canvas;
+  // Current default path, kept in device space (see sk_context_user_path)
   SkPath* path;
-  std::vector<sk_context_state*> states;
+  // Reused for building segments and for mapping the path back to user space
+  SkPath scratchPath;
+  // Saved states followed by the current one, which `state` points to
+  std::vector<sk_context_state> states;
   sk_context_state* state;
+  // Paints derived from the current state, see sk_context_update_paints.
+  // Kept out of the states so that save() doesn't copy them.
+  bool paintsDirty;
+  SkPaint fillPaint;
+  SkPaint strokePaint;
+  SkVector shadowScale;
+  std::optional<SkPaint> fillShadowPaint;
+  std::optional<SkPaint> strokeShadowPaint;
+  std::optional<SkPaint> imageShadowPaint;
+  // Reused between text calls, see sk_context_text_builder
+  skia::textlayout::ParagraphBuilder* textBuilder;
+  TextDirection textBuilderDirection;
+  // Font collection the builder was made with, see sk_font_collection
+  const void* textBuilderFonts;
 } sk_context;
 
 extern "C" {
   SKIA_EXPORT void sk_init();
   SKIA_EXPORT sk_canvas* sk_canvas_create(int width, int height);
+  SKIA_EXPORT sk_canvas* sk_canvas_create_typed(int width, int height, int colorType, int opaque);
+  SKIA_EXPORT int sk_canvas_get_color_type(sk_canvas* canvas);
+  SKIA_EXPORT int sk_canvas_set_opaque(sk_canvas* canvas);
+  SKIA_EXPORT sk_canvas* sk_canvas_create_direct(int width, int height, int colorType, void* pixels, size_t rowBytes);
   SKIA_EXPORT sk_canvas* sk_canvas_create_gl(int width, int height);
   SKIA_EXPORT void sk_canvas_destroy(sk_canvas* canvas);
   SKIA_EXPORT int sk_canvas_save(sk_canvas* canvas, char* path, int format, int quality);
+  SKIA_EXPORT int sk_canvas_render_to_file(SkPicture* picture, char* path, int width, int height, int format, int quality, int stripHeight);
   SKIA_EXPORT void sk_canvas_read_pixels(sk_canvas* canvas, int x, int y, int width, int height, void* pixels, int cs);
   SKIA_EXPORT const void* sk_canvas_encode_image(sk_canvas* canvas, int format, int quality, int* size, SkData** data);
   SKIA_EXPORT void sk_data_free(SkData* data);
@@ -65,4 +138,8 @@ extern "C" {
   SKIA_EXPORT sk_context* sk_canvas_get_context(sk_canvas* canvas);
   SKIA_EXPORT void sk_canvas_set_size(sk_canvas* canvas, int width, int height);
   SKIA_EXPORT void sk_canvas_flush(sk_canvas* canvas);
+  SKIA_EXPORT void sk_canvas_draw_picture_tiled(sk_canvas* canvas, SkPicture* picture, int tileSize, int threads);
+  SKIA_EXPORT void sk_canvas_encode_cache_get_stats(sk_canvas* canvas, uint64_t* out);
+  SKIA_EXPORT void* sk_canvas_lock_pixels(sk_canvas* canvas, int write, int* out);
+  SKIA_EXPORT void sk_canvas_unlock_pixels(sk_canvas* canvas, int write);
 }
@@ -5,8 +5,13 @@
 #include <math.h>
 #endif
 
+#include "include/core/SkColorType.h"
 #include "include/core/SkEncodedImageFormat.h"
 #include "include/core/SkShader.h"
+#include "include/core/SkString.h"
+#include <memory>
+#include <string>
+#include <vector>
 
 #ifndef SKIA_EXPORT
   #if defined(_WIN32)
@@ -97,9 +102,19 @@ enum FontStretch {
   kUltraExpanded
 };
 
+// Family string along with its split family list
+typedef struct FontFamily {
+  std::string name;
+  std::vector<SkString> families;
+} FontFamily;
+
 typedef struct Font {
   float size;
-  char* family;
+  // Point into the interned FontFamily, or into `uninterned` once the intern
+  // table is full, see set_font_family
+  const char* family;
+  const std::vector<SkString>* families;
+  std::shared_ptr<const FontFamily> uninterned;
   uint32_t weight;
   FontStyle style;
   FontVariant variant;
@@ -123,3 +138,14 @@ typedef struct sk_line_metrics {
 #define ALMOST_EQUAL(a, b) (fabs((a) - (b)) < 0.00001)
 
 SkEncodedImageFormat format_from_int(int format);
+
+// Pixel formats of canvases, CColorType in src/canvas.ts. SkColorType values
+// change between Skia versions, so they aren't passed to JS as is.
+SkColorType color_type_from_int(int colorType);
+int color_type_to_int(SkColorType colorType);
+
+extern "C" {
+  // Number of allocations so far in builds with CANVAS_COUNT_ALLOCATIONS, -1
+  // otherwise
+  SKIA_EXPORT int64_t sk_debug_allocation_count();
+}
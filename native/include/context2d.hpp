@@ -5,13 +5,69 @@
 #include "include/core/SkPath.h"
 #include "include/common.hpp"
 #include "include/core/SkPathEffect.h"
+#include "include/core/SkPicture.h"
 #include "include/canvas.hpp"
 #include "include/gradient.hpp"
 #include "include/pattern.hpp"
 
-sk_context_state* create_default_state();
-sk_context_state* clone_context_state(sk_context_state* state);
-void free_context_state(sk_context_state* state);
+void set_font_family(Font* font, const char* family);
+void init_default_state(sk_context_state* state);
+sk_context* create_context(SkCanvas* canvas);
+
+// Opcodes understood by sk_context_execute, keep in sync with `Op` in
+// src/commands.ts. Each command is a u32 opcode followed by its f32
+// arguments; commands taking a string store it inline after the arguments.
+enum ContextOp {
+  kOpClearRect,
+  kOpFillRect,
+  kOpStrokeRect,
+  kOpFillText,
+  kOpStrokeText,
+  kOpSetLineWidth,
+  kOpSetLineCap,
+  kOpSetLineJoin,
+  kOpSetMiterLimit,
+  kOpSetLineDash,
+  kOpSetLineDashOffset,
+  kOpSetFont,
+  kOpSetTextAlign,
+  kOpSetTextBaseline,
+  kOpSetTextDirection,
+  kOpSetLetterSpacing,
+  kOpSetWordSpacing,
+  kOpSetFillStyle,
+  kOpSetStrokeStyle,
+  kOpSetShadowBlur,
+  kOpSetShadowColor,
+  kOpSetShadowOffsetX,
+  kOpSetShadowOffsetY,
+  kOpBeginPath,
+  kOpClosePath,
+  kOpMoveTo,
+  kOpLineTo,
+  kOpBezierCurveTo,
+  kOpQuadraticCurveTo,
+  kOpArc,
+  kOpArcTo,
+  kOpEllipse,
+  kOpRect,
+  kOpRoundRect,
+  kOpFill,
+  kOpStroke,
+  kOpClip,
+  kOpRotate,
+  kOpScale,
+  kOpTranslate,
+  kOpTransform,
+  kOpSetTransform,
+  kOpResetTransform,
+  kOpSetGlobalAlpha,
+  kOpSetGlobalCompositeOperation,
+  kOpSetImageSmoothingEnabled,
+  kOpSetImageSmoothingQuality,
+  kOpSave,
+  kOpRestore,
+};
 
 extern "C" {
   SKIA_EXPORT void sk_context_clear_rect(sk_context* context, float x, float y, float width, float height);
@@ -28,6 +84,8 @@ extern "C" {
     sk_line_metrics* out_metrics
   );
 
+  SKIA_EXPORT void sk_context_measure_text_batch(sk_context* context, const char* utf8, const uint32_t* offsets, int count, sk_line_metrics* out);
+
   SKIA_EXPORT float sk_context_get_line_width(sk_context* context);
   SKIA_EXPORT  void sk_context_set_line_width(sk_context* context, float width);
   SKIA_EXPORT   int sk_context_get_line_cap(sk_context* context);
@@ -40,7 +98,7 @@ extern "C" {
   SKIA_EXPORT float sk_context_get_line_dash_offset(sk_context* context);
   SKIA_EXPORT  void sk_context_set_line_dash_offset(sk_context* context, float offset);
 
-  SKIA_EXPORT void sk_context_set_font(
+  SKIA_EXPORT   int sk_context_set_font(
     sk_context* context,
     float size,
     char* family,
@@ -121,6 +179,7 @@ extern "C" {
     float dw,
     float dh
   );
+  SKIA_EXPORT void sk_context_draw_picture(sk_context* context, SkPicture* picture, float dx, float dy, float dw, float dh);
 
   SKIA_EXPORT void sk_context_put_image_data(sk_context* context, int width, int height, uint8_t *pixels, int row_bytes, float x, float y);
   SKIA_EXPORT void sk_context_put_image_data_dirty(sk_context* context, int width, int height, uint8_t *pixels, int row_bytes, int length, float x, float y, float dirty_x, float dirty_y, float dirty_width, float dirty_height, uint8_t cs);
@@ -145,5 +204,7 @@ extern "C" {
   SKIA_EXPORT void sk_context_filter_saturated(sk_context* context, float saturate);
   SKIA_EXPORT void sk_context_filter_sepia(sk_context* context, float sepia);
   
+  SKIA_EXPORT void sk_context_execute(sk_context* context, const uint8_t* ops, size_t len);
+
   SKIA_EXPORT void sk_context_destroy(sk_context* context);
 }
@@ -1,18 +1,67 @@
 #pragma once
 
 #include <filesystem>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "include/common.hpp"
 #include "include/core/SkFont.h"
 #include "include/core/SkFontMgr.h"
 #include "modules/skparagraph/include/FontCollection.h"
 #include "modules/skparagraph/include/TypefaceFontProvider.h"
 
+// Font provider that can index fonts without loading them: the family names
+// of each file are read from its name table (or from a cache file), and the
+// typefaces of a family are only created the first time it is matched.
+//
+// Matching may register typefaces, so all lookups are serialized by the
+// provider itself; registering from outside needs fontLock held exclusively.
+class FontIndexProvider : public skia::textlayout::TypefaceFontProvider {
+public:
+  // Indexes all fonts under dir, reusing the index in cachePath (if not null)
+  // while no directory under dir has changed. Returns the number of faces.
+  int indexDir(const char* dir, const char* cachePath);
+
+  SkFontStyleSet* onMatchFamily(const char familyName[]) const override;
+  SkTypeface* onMatchFamilyStyle(const char familyName[], const SkFontStyle& style) const override;
+  int onCountFamilies() const override;
+  void onGetFamilyName(int index, SkString* familyName) const override;
+  SkFontStyleSet* onCreateStyleSet(int index) const override;
+  sk_sp<SkTypeface> onLegacyMakeTypeface(const char familyName[], SkFontStyle style) const override;
+
+private:
+  typedef struct Face {
+    std::string path;
+    int index;
+  } Face;
+
+  void loadFamily(const char* familyName) const;
+
+  mutable std::unordered_map<std::string, std::vector<Face>> pending;
+  // Recursive as the base class implements some lookups with others
+  mutable std::recursive_mutex mutex;
+};
+
+// Guards the registered fonts. Text layout holds it shared, registering
+// fonts holds it exclusively. Drawing already laid out text needs no lock.
+extern std::shared_mutex fontLock;
+
+// Font collection of the calling thread. FontCollection caches lookups
+// without synchronization, so each thread gets its own, all sharing the
+// registered fonts. It is replaced after fonts are registered, which is how
+// holders of the previous one (paragraph builders) notice the change.
+const sk_sp<skia::textlayout::FontCollection>& sk_font_collection();
+
 extern "C" {
   SKIA_EXPORT void setup_font_collection();
   SKIA_EXPORT int fonts_register_path(const char* path, char* alias);
   SKIA_EXPORT int fonts_register_memory(const void* data, size_t length, char* alias);
   SKIA_EXPORT int fonts_register_dir(char* path);
+  SKIA_EXPORT int fonts_index_dir(char* path);
   SKIA_EXPORT int load_system_fonts();
+  SKIA_EXPORT int index_system_fonts(const char* cachePath);
   SKIA_EXPORT void fonts_set_alias(char* alias, char* family);
   SKIA_EXPORT int fonts_count();
   SKIA_EXPORT char* fonts_family(int index);
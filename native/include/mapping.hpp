@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+#include "include/common.hpp"
+
+extern "C" {
+  SKIA_EXPORT void* sk_file_map(const char* path, uint64_t size, int create);
+  SKIA_EXPORT void sk_file_unmap(void* pixels, uint64_t size);
+}
@@ -9,6 +9,8 @@
 #include "include/core/SkPathUtils.h"
 #include "include/common.hpp"
 
+void sk_path_add_ellipse(SkPath* path, const SkMatrix& matrix, float x, float y, float radiusX, float radiusY, float rotation, float startAngle, float endAngle, bool clockwise);
+
 extern "C" {
   SKIA_EXPORT SkPath* sk_path_create();
   SKIA_EXPORT SkPath* sk_path_create_copy(SkPath* path);
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "include/common.hpp"
+#include "include/core/SkPixmap.h"
+#include "include/core/SkStream.h"
+
+// Whether sk_encode_png_parallel should be used for this image: false if
+// built without zlib, disabled with sk_png_set_threads(1), or the image is
+// too small to be split.
+bool sk_png_use_parallel(const SkPixmap& pixmap);
+
+// Encodes a PNG using several threads: the image is split into strips of
+// rows, each filtered and deflated independently, and the strips are
+// joined into one zlib stream. The filters are SkPngEncoder::FilterFlag
+// bits.
+bool sk_encode_png_parallel(SkWStream* stream, const SkPixmap& pixmap, int zlibLevel, int filters);
+
+extern "C" {
+  // Threads used to encode PNGs: 0 for one per core (the default), 1 to
+  // always use Skia's single-threaded encoder
+  SKIA_EXPORT void sk_png_set_threads(int threads);
+  SKIA_EXPORT int sk_png_get_threads();
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "include/common.hpp"
+#include "include/context2d.hpp"
+#include "include/core/SkPicture.h"
+#include "include/core/SkPictureRecorder.h"
+
+// A canvas that records drawing into an immutable SkPicture (a display
+// list) instead of pixels. Pictures can then be replayed onto any other
+// canvas with sk_context_draw_picture, or rendered by a sk_render_pool.
+typedef struct sk_recorder {
+  SkPictureRecorder* recorder;
+  // Null once the recording is finished
+  sk_context* context;
+} sk_recorder;
+
+extern "C" {
+  SKIA_EXPORT sk_recorder* sk_recorder_create(float width, float height);
+  SKIA_EXPORT void sk_recorder_destroy(sk_recorder* recorder);
+  SKIA_EXPORT sk_context* sk_recorder_get_context(sk_recorder* recorder);
+  SKIA_EXPORT SkPicture* sk_recorder_finish(sk_recorder* recorder);
+
+  SKIA_EXPORT void sk_picture_destroy(SkPicture* picture);
+  SKIA_EXPORT void sk_picture_get_bounds(SkPicture* picture, float* out);
+  SKIA_EXPORT SkData* sk_picture_serialize(SkPicture* picture, const void** buffer, unsigned int* size);
+  SKIA_EXPORT SkPicture* sk_picture_deserialize(const void* data, size_t length);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "include/common.hpp"
+#include "include/core/SkData.h"
+#include "include/core/SkPicture.h"
+
+// A drawing to rasterize and encode on a pool thread, either a recorded
+// picture scaled to the canvas size or, without a picture, `ops`: a
+// command buffer as replayed by sk_context_execute.
+typedef struct sk_render_job {
+  uint32_t id;
+  int width;
+  int height;
+  int format;
+  int quality;
+  sk_sp<SkPicture> picture;
+  std::vector<uint8_t> ops;
+} sk_render_job;
+
+typedef struct sk_render_result {
+  uint32_t id;
+  // Null if the canvas could not be created or encoded
+  sk_sp<SkData> data;
+} sk_render_result;
+
+// Fixed set of threads rendering jobs in submission order. Finished jobs go
+// to a completion queue, which is polled from JS (after awaiting
+// sk_render_pool_wait, which blocks outside of the JS thread).
+typedef struct sk_render_pool {
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable jobsReady;
+  std::condition_variable resultsReady;
+  std::deque<sk_render_job> jobs;
+  std::deque<sk_render_result> results;
+  uint32_t nextId;
+  // Submitted jobs whose result hasn't been polled yet
+  int pending;
+  bool stopping;
+} sk_render_pool;
+
+extern "C" {
+  SKIA_EXPORT sk_render_pool* sk_render_pool_create(int threads);
+  SKIA_EXPORT void sk_render_pool_destroy(sk_render_pool* pool);
+  SKIA_EXPORT int sk_render_pool_thread_count(sk_render_pool* pool);
+  SKIA_EXPORT uint32_t sk_render_pool_submit(sk_render_pool* pool, const uint8_t* ops, size_t len, int width, int height, int format, int quality);
+  SKIA_EXPORT uint32_t sk_render_pool_submit_picture(sk_render_pool* pool, SkPicture* picture, int width, int height, int format, int quality);
+  SKIA_EXPORT int sk_render_pool_wait(sk_render_pool* pool);
+  SKIA_EXPORT int sk_render_pool_poll(sk_render_pool* pool, uint32_t* id, int* size, const void** bytes, SkData** data);
+}
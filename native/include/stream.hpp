@@ -0,0 +1,99 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "include/common.hpp"
+#include "include/core/SkData.h"
+#include "include/core/SkImage.h"
+#include "include/core/SkStream.h"
+#include "include/canvas.hpp"
+
+// Encodes pixels into a stream as the encoder produces them.
+bool sk_encode_pixmap(SkWStream* stream, const SkPixmap& pixmap, const sk_encode_options& options);
+
+// Same as sk_encode_pixmap with the settings of SkImage::encodeToData.
+bool sk_encode_pixmap(SkWStream* stream, const SkPixmap& pixmap, int format, int quality);
+
+// Image with the current content of a canvas. While JS has the pixels
+// locked this is a copy, see sk_canvas_lock_pixels.
+sk_sp<SkImage> sk_canvas_snapshot(sk_canvas* canvas);
+
+// Raster image with the current content of a canvas, GPU canvases are read
+// back. Must be called on the thread owning the canvas.
+sk_sp<SkImage> sk_canvas_raster_snapshot(sk_canvas* canvas);
+
+// Writes to a file descriptor owned by the caller.
+class FDWStream : public SkWStream {
+public:
+  explicit FDWStream(int fd) : fd(fd), written(0) {}
+
+  bool write(const void* buffer, size_t size) override;
+  size_t bytesWritten() const override { return written; }
+
+private:
+  int fd;
+  size_t written;
+};
+
+// Encoded bytes passed from an encoding thread to JS in chunks of
+// kChunkSize. At most kMaxChunks are queued, after which the encoder waits
+// for JS to read, so memory stays bounded however slow the reader is.
+class ChunkWStream : public SkWStream {
+public:
+  static constexpr size_t kChunkSize = 64 * 1024;
+  static constexpr size_t kMaxChunks = 4;
+
+  bool write(const void* buffer, size_t size) override;
+  void flush() override;
+  size_t bytesWritten() const override { return written; }
+
+  // Called by the encoding thread when done
+  void finish(bool success);
+  // Reader side, see sk_encode_stream_wait/read
+  int wait();
+  int read(uint8_t* out, int capacity);
+  // Makes pending and future writes fail, so the encoder stops early
+  void cancel();
+
+private:
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::vector<uint8_t>> chunks;
+  std::vector<uint8_t> current;
+  size_t readOffset = 0;
+  size_t written = 0;
+  bool done = false;
+  bool failed = false;
+  bool cancelled = false;
+};
+
+typedef struct sk_encode_stream {
+  ChunkWStream stream;
+  std::thread thread;
+} sk_encode_stream;
+
+// Whole image encoded on a background thread, see
+// sk_canvas_encode_image_async
+typedef struct sk_encode_job {
+  std::thread thread;
+  sk_sp<SkData> data;
+} sk_encode_job;
+
+extern "C" {
+  SKIA_EXPORT int sk_canvas_save_fd(sk_canvas* canvas, int fd, int format, int quality);
+  SKIA_EXPORT sk_encode_stream* sk_canvas_encode_stream(sk_canvas* canvas, int format, int quality);
+  SKIA_EXPORT int sk_encode_stream_wait(sk_encode_stream* stream);
+  SKIA_EXPORT int sk_encode_stream_read(sk_encode_stream* stream, uint8_t* out, int capacity);
+  SKIA_EXPORT void sk_encode_stream_destroy(sk_encode_stream* stream);
+  SKIA_EXPORT const void* sk_canvas_encode_image_ex(sk_canvas* canvas, const sk_encode_options* options, int* size, SkData** data);
+  SKIA_EXPORT sk_encode_job* sk_canvas_encode_image_async(sk_canvas* canvas, const sk_encode_options* options);
+  SKIA_EXPORT int sk_encode_job_wait(sk_encode_job* job);
+  SKIA_EXPORT const void* sk_encode_job_finish(sk_encode_job* job, int* size, SkData** data);
+  // Whether sk_canvas_encode_image_ex keeps encoded images (the default),
+  // turned off to measure or test the encoders themselves
+  SKIA_EXPORT void sk_encode_cache_set_enabled(int enabled);
+  SKIA_EXPORT int sk_encode_cache_get_enabled();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include "include/common.hpp"
+#include "include/core/SkFontMetrics.h"
+#include "include/core/SkRect.h"
+#include "include/core/SkTextBlob.h"
+#include "modules/skparagraph/include/Paragraph.h"
+
+// A shaped and laid out line of text along with the measurements fillText
+// and measureText need. It does not depend on alignment, baseline or paint,
+// so it can be shared between calls through the text cache.
+//
+// Simple text is shaped straight into `blob` (drawn with its baseline at
+// alphabeticBaseline), everything else goes through skparagraph.
+typedef struct sk_text_layout {
+  std::unique_ptr<skia::textlayout::Paragraph> paragraph;
+  sk_sp<SkTextBlob> blob;
+  SkFontMetrics fontMetrics;
+  float alphabeticBaseline;
+  float ideographicBaseline;
+  float height;
+  SkRect firstCharBounds;
+  SkRect lastCharBounds;
+  float lastCharPosX;
+  float ascent;
+  float descent;
+  float lineLeft;
+  double width;
+} sk_text_layout;
+
+// Builds the cache key for text laid out with the given font settings. The
+// returned string is reused by the next call on the same thread.
+const std::string& sk_text_cache_key(const Font& font, float letterSpacing, float wordSpacing, int direction, const char* text, int textLen);
+std::shared_ptr<sk_text_layout> sk_text_cache_get(const std::string& key);
+void sk_text_cache_put(const std::string& key, std::shared_ptr<sk_text_layout> layout, int textLen);
+bool sk_text_fast_path_enabled();
+
+extern "C" {
+  SKIA_EXPORT void sk_text_cache_set_budget(size_t bytes);
+  SKIA_EXPORT void sk_text_cache_get_stats(uint64_t* out);
+  SKIA_EXPORT void sk_text_cache_clear();
+  // Toggles the simple text fast path, used to compare it against skparagraph
+  SKIA_EXPORT void sk_text_set_fast_path(int enabled);
+}
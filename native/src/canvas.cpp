@@ -1,9 +1,70 @@
 #include "include/canvas.hpp"
 #include "include/context2d.hpp"
+#include "include/stream.hpp"
 #include "include/core/SkImageInfo.h"
 #include "include/core/SkStream.h"
+#include "include/encode/SkJpegEncoder.h"
+#include "include/encode/SkPngEncoder.h"
 #include "include/gpu/GrBackendSurface.h"
 #include "include/gpu/gl/GrGLInterface.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// Formats without an alpha channel are opaque, the others premultiplied
+static SkAlphaType canvas_alpha_type(SkColorType colorType) {
+  return SkColorTypeIsAlwaysOpaque(colorType) ? kOpaque_SkAlphaType : kPremul_SkAlphaType;
+}
+
+// Opaque canvases start out opaque black, as in browsers
+static sk_sp<SkSurface> make_raster_surface(const SkImageInfo& info) {
+  auto surface = SkSurface::MakeRaster(info);
+  if (surface != nullptr && info.isOpaque()) surface->getCanvas()->clear(SK_ColorBLACK);
+  return surface;
+}
+
+// Streams the picture into the encoder strip by strip, see
+// sk_canvas_render_to_file.
+//
+// This relies on how SkEncoder works in the Skia version this library is
+// built against (2290b0b, see scripts/build_skia.ts): it keeps a reference
+// to the source pixmap passed to Make, and encodeRows reads each row at
+// fSrc.addr(0, row). So the pixmap stays full height with the real row
+// stride, and before each strip its base address is moved up by the rows
+// above the strip: rows [top, top + rows) then land in the strip buffer,
+// which is all the encoder reads. Revisit when updating Skia.
+static bool encode_picture_strips(SkWStream* stream, SkPicture* picture, SkEncodedImageFormat format, int width, int height, int quality, int stripHeight) {
+  auto info = SkImageInfo::MakeN32Premul(width, height);
+  auto rowBytes = info.minRowBytes();
+  stripHeight = std::min(stripHeight, height);
+  std::vector<uint8_t> strip(rowBytes * stripHeight);
+
+  SkPixmap source(info, strip.data(), rowBytes);
+  std::unique_ptr<SkEncoder> encoder;
+  if (format == SkEncodedImageFormat::kPNG) {
+    encoder = SkPngEncoder::Make(stream, source, SkPngEncoder::Options());
+  } else {
+    SkJpegEncoder::Options options;
+    options.fQuality = quality;
+    encoder = SkJpegEncoder::Make(stream, source, options);
+  }
+  if (encoder == nullptr) return false;
+
+  auto matrix = SkMatrix::RectToRect(picture->cullRect(), SkRect::MakeIWH(width, height));
+  for (int top = 0; top < height; top += stripHeight) {
+    int rows = std::min(stripHeight, height - top);
+    memset(strip.data(), 0, rowBytes * rows);
+    auto canvas = SkCanvas::MakeRasterDirect(info.makeWH(width, rows), strip.data(), rowBytes);
+    canvas->translate(0, -top);
+    canvas->drawPicture(picture, &matrix, nullptr);
+    source.reset(info, strip.data() - top * rowBytes, rowBytes);
+    if (!encoder->encodeRows(rows)) return false;
+  }
+  return true;
+}
 
 extern "C" {
   void sk_init() {
@@ -18,6 +79,56 @@ extern "C" {
     return canvas;
   }
 
+  // Raster canvas in one of the CColorType formats (N32 if negative),
+  // smaller than N32 for masks (A8) or opaque images (565), or with more
+  // range (F16). Opaque canvases ({ alpha: false }) let Skia skip blending
+  // with what is below, and encode without an alpha channel.
+  sk_canvas* sk_canvas_create_typed(int width, int height, int colorType, int opaque) {
+    auto type = colorType < 0 ? kN32_SkColorType : color_type_from_int(colorType);
+    auto alphaType = opaque ? kOpaque_SkAlphaType : canvas_alpha_type(type);
+    auto surface = make_raster_surface(SkImageInfo::Make(width, height, type, alphaType));
+    if (surface == nullptr) return nullptr;
+    sk_canvas* canvas = new sk_canvas();
+    canvas->backend = kBackendCPU;
+    canvas->surface = surface.release();
+    canvas->context_2d = sk_canvas_create_context(canvas);
+    return canvas;
+  }
+
+  int sk_canvas_get_color_type(sk_canvas* canvas) {
+    return color_type_to_int(canvas->surface->imageInfo().colorType());
+  }
+
+  // Replaces the surface of a raster canvas with an opaque black one of the
+  // same size and format, for getContext("2d", { alpha: false })
+  int sk_canvas_set_opaque(sk_canvas* canvas) {
+    auto info = canvas->surface->imageInfo();
+    if (canvas->backend != kBackendCPU) return 0;
+    if (info.isOpaque()) return 1;
+    auto surface = make_raster_surface(info.makeAlphaType(kOpaque_SkAlphaType));
+    if (surface == nullptr) return 0;
+    canvas->surface->unref();
+    sk_context_destroy((sk_context*) canvas->context_2d);
+    canvas->surface = surface.release();
+    canvas->context_2d = sk_canvas_create_context(canvas);
+    return 1;
+  }
+
+  // Raster canvas drawing into pixels owned by the caller, such as a
+  // mapped file, which must outlive it. A negative color type is N32.
+  sk_canvas* sk_canvas_create_direct(int width, int height, int colorType, void* pixels, size_t rowBytes) {
+    auto type = colorType < 0 ? kN32_SkColorType : color_type_from_int(colorType);
+    auto info = SkImageInfo::Make(width, height, type, canvas_alpha_type(type));
+    auto surface = SkSurface::MakeRasterDirect(info, pixels, rowBytes);
+    if (surface == nullptr) return nullptr;
+    sk_canvas* canvas = new sk_canvas();
+    canvas->backend = kBackendCPU;
+    canvas->surface = surface.release();
+    canvas->direct = true;
+    canvas->context_2d = sk_canvas_create_context(canvas);
+    return canvas;
+  }
+
   sk_canvas* sk_canvas_create_gl(int width, int height) {
     sk_canvas* canvas = new sk_canvas();
     canvas->backend = kBackendOpenGL;
@@ -63,24 +174,85 @@ extern "C" {
     canvas->context->flush();
   }
 
+  // Draws a picture scaled to the whole canvas, splitting the canvas into
+  // tileSize x tileSize tiles which are played back concurrently on
+  // `threads` threads (one per core if 0), each drawing straight into its
+  // part of the pixels. Pictures are immutable, so tiles can share them.
+  void sk_canvas_draw_picture_tiled(sk_canvas* canvas, SkPicture* picture, int tileSize, int threads) {
+    auto bounds = picture->cullRect();
+    if (bounds.isEmpty()) return;
+    auto matrix = SkMatrix::RectToRect(bounds, SkRect::MakeIWH(canvas->surface->width(), canvas->surface->height()));
+
+    SkPixmap pixels;
+    if (canvas->backend != kBackendCPU || tileSize <= 0 || !canvas->surface->peekPixels(&pixels)) {
+      canvas->surface->getCanvas()->drawPicture(picture, &matrix, nullptr);
+      return;
+    }
+    // Snapshots share the pixels until the next draw, detach them first
+    canvas->surface->notifyContentWillChange(SkSurface::kRetain_ContentChangeMode);
+
+    int columns = (pixels.width() + tileSize - 1) / tileSize;
+    int rows = (pixels.height() + tileSize - 1) / tileSize;
+    int tiles = columns * rows;
+    if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, tiles);
+
+    std::atomic<int> next { 0 };
+    auto run = [&] {
+      for (int tile = next++; tile < tiles; tile = next++) {
+        auto rect = SkIRect::MakeXYWH((tile % columns) * tileSize, (tile / columns) * tileSize, tileSize, tileSize);
+        rect.intersect(pixels.bounds());
+        SkPixmap subset;
+        pixels.extractSubset(&subset, rect);
+        auto tileCanvas = SkCanvas::MakeRasterDirect(subset.info(), subset.writable_addr(), subset.rowBytes());
+        tileCanvas->translate(-rect.x(), -rect.y());
+        tileCanvas->drawPicture(picture, &matrix, nullptr);
+      }
+    };
+    std::vector<std::thread> pool;
+    for (int i = 1; i < threads; i++) pool.emplace_back(run);
+    run();
+    for (auto& thread : pool) thread.join();
+  }
+
   void sk_canvas_destroy(sk_canvas* canvas) {
     canvas->surface->unref();
     sk_context_destroy((sk_context*) canvas->context_2d);
     delete canvas;
   }
 
+  // Encodes straight into the file, without an encoded copy in memory
   int sk_canvas_save(sk_canvas* canvas, char* path, int format, int quality) {
-    auto info = canvas->surface->makeImageSnapshot();
-    auto buf = info->encodeToData(format_from_int(format), quality);
-    if (buf) {
+    auto image = sk_canvas_raster_snapshot(canvas);
+    SkPixmap pixmap;
+    if (image == nullptr || !image->peekPixels(&pixmap)) return 0;
+    SkFILEWStream stream(path);
+    if (!stream.isValid() || !sk_encode_pixmap(&stream, pixmap, format, quality)) return 0;
+    stream.flush();
+    return 1;
+  }
+
+  // Renders a picture scaled to width x height straight into an image file,
+  // without ever holding the whole image: the picture is played back one
+  // horizontal strip at a time into a single strip buffer, and each strip
+  // is handed to a row-streaming encoder. Only PNG and JPEG support that.
+  // The file is removed again if rendering fails.
+  int sk_canvas_render_to_file(SkPicture* picture, char* path, int width, int height, int format, int quality, int stripHeight) {
+    auto bounds = picture->cullRect();
+    if (bounds.isEmpty() || width <= 0 || height <= 0 || stripHeight <= 0) return 0;
+    auto encodedFormat = format_from_int(format);
+    if (encodedFormat != SkEncodedImageFormat::kPNG && encodedFormat != SkEncodedImageFormat::kJPEG) return 0;
+
+    bool opened, encoded;
+    {
       SkFILEWStream stream(path);
-      if (stream.write(buf->data(), buf->size())) {
-        stream.flush();
-        buf.release();
-        return 1;
-      }
+      opened = stream.isValid();
+      encoded = opened && encode_picture_strips(&stream, picture, encodedFormat, width, height, quality, stripHeight);
+      if (encoded) stream.flush();
     }
-    return 0;
+    // Don't leave a truncated image behind
+    if (opened && !encoded) std::remove(path);
+    return encoded;
   }
 
   void sk_canvas_read_pixels(sk_canvas* canvas, int x, int y, int width, int height, void* pixels, int cs) {
@@ -88,32 +260,57 @@ extern "C" {
   }
 
   const void* sk_canvas_encode_image(sk_canvas* canvas, int format, int quality, int* size, SkData** data) {
-    auto info = canvas->surface->makeImageSnapshot();
-    auto buf = info->encodeToData(format_from_int(format), quality);
-    if (buf) {
-      auto ptr = buf->data();
-      *size = buf->size();
-      *data = buf.release();
-      return ptr;
-    }
-    return nullptr;
+    sk_encode_options options = { format, quality, -1, -1, -1, -1, -1 };
+    return sk_canvas_encode_image_ex(canvas, &options, size, data);
   }
 
-  void sk_data_free(SkData* data) {
-    data->unref();
+  // Address of the pixels of a raster canvas, for JS to read or write them
+  // in place. out receives the width, height, row bytes, color type (see
+  // color_type_to_int) and SkAlphaType. Returns null for GPU canvases or if
+  // already locked.
+  //
+  // Before writes, pixels shared with a snapshot (such as one being encoded)
+  // are copied, so the snapshot keeps its content. Snapshots taken while
+  // locked are copies, see sk_canvas_snapshot.
+  void* sk_canvas_lock_pixels(sk_canvas* canvas, int write, int* out) {
+    if (canvas->pixelsLocked) return nullptr;
+    if (write) canvas->surface->notifyContentWillChange(SkSurface::kRetain_ContentChangeMode);
+    SkPixmap pixmap;
+    if (!canvas->surface->peekPixels(&pixmap)) return nullptr;
+    canvas->pixelsLocked = true;
+    out[0] = pixmap.width();
+    out[1] = pixmap.height();
+    out[2] = pixmap.rowBytes();
+    out[3] = color_type_to_int(pixmap.colorType());
+    out[4] = pixmap.alphaType();
+    return pixmap.writable_addr();
   }
 
-  sk_context* sk_canvas_create_context(sk_canvas* canvas) {
-    sk_context* context = new sk_context();
-    
-    context->canvas = canvas->surface->getCanvas();
+  // Ends access to the pixels. After writes the content generation changes
+  // again, so nothing cached while the pixels were locked (such as encoded
+  // images) is reused.
+  void sk_canvas_unlock_pixels(sk_canvas* canvas, int write) {
+    if (!canvas->pixelsLocked) return;
+    canvas->pixelsLocked = false;
+    if (write) canvas->surface->notifyContentWillChange(SkSurface::kRetain_ContentChangeMode);
+  }
 
-    context->path = new SkPath();
+  // Hits, misses, entries and bytes of the encoded image cache
+  void sk_canvas_encode_cache_get_stats(sk_canvas* canvas, uint64_t* out) {
+    uint64_t bytes = 0;
+    for (auto& entry : canvas->encodeCache) bytes += entry.data->size();
+    out[0] = canvas->encodeCacheHits;
+    out[1] = canvas->encodeCacheMisses;
+    out[2] = canvas->encodeCache.size();
+    out[3] = bytes;
+  }
 
-    context->state = create_default_state();
-    context->states = std::vector<sk_context_state*>();
+  void sk_data_free(SkData* data) {
+    data->unref();
+  }
 
-    return context;
+  sk_context* sk_canvas_create_context(sk_canvas* canvas) {
+    return create_context(canvas->surface->getCanvas());
   }
 
   sk_context* sk_canvas_get_context(sk_canvas* canvas) {
@@ -122,10 +319,11 @@ extern "C" {
 
   void sk_canvas_set_size(sk_canvas* canvas, int width, int height) {
     if (canvas->backend == kBackendCPU) {
-      // Raster canvas
+      // Raster canvas, keeping its format
+      auto info = canvas->surface->imageInfo().makeWH(width, height);
       canvas->surface->unref();
       sk_context_destroy((sk_context*) canvas->context_2d);
-      canvas->surface = SkSurface::MakeRasterN32Premul(width, height).release();
+      canvas->surface = make_raster_surface(info).release();
       canvas->context_2d = sk_canvas_create_context(canvas);
     } else if (canvas->backend == kBackendOpenGL) {
       // OpenGL canvas
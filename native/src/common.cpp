@@ -1,4 +1,8 @@
 #include "include/common.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <iterator>
+#include <new>
 
 SkEncodedImageFormat format_from_int(int format) {
   switch (format) {
@@ -10,3 +14,80 @@ SkEncodedImageFormat format_from_int(int format) {
       return SkEncodedImageFormat::kWEBP;
   }
 }
+
+static const SkColorType colorTypes[] = {
+  kRGBA_8888_SkColorType,
+  kBGRA_8888_SkColorType,
+  kAlpha_8_SkColorType,
+  kRGB_565_SkColorType,
+  kRGBA_F16_SkColorType,
+  kRGB_888x_SkColorType,
+};
+
+SkColorType color_type_from_int(int colorType) {
+  if (colorType < 0 || colorType >= (int) std::size(colorTypes)) return kUnknown_SkColorType;
+  return colorTypes[colorType];
+}
+
+int color_type_to_int(SkColorType colorType) {
+  for (int i = 0; i < (int) std::size(colorTypes); i++) {
+    if (colorTypes[i] == colorType) return i;
+  }
+  return -1;
+}
+
+// Builds with CANVAS_COUNT_ALLOCATIONS count allocations so tests can check
+// that hot paths don't allocate, see sk_debug_allocation_count. With
+// CANVAS_WRAP_MALLOC the linker routes every malloc of this library and the
+// Skia archives linked into it through the wrappers below, which also covers
+// operator new. Otherwise only operator new is counted.
+#ifdef CANVAS_COUNT_ALLOCATIONS
+static std::atomic<int64_t> allocationCount { 0 };
+
+#ifdef CANVAS_WRAP_MALLOC
+extern "C" {
+  void* __real_malloc(size_t size);
+  void* __real_calloc(size_t count, size_t size);
+  void* __real_realloc(void* ptr, size_t size);
+
+  void* __wrap_malloc(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __real_malloc(size);
+  }
+
+  void* __wrap_calloc(size_t count, size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __real_calloc(count, size);
+  }
+
+  void* __wrap_realloc(void* ptr, size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __real_realloc(ptr, size);
+  }
+}
+#endif
+
+void* operator new(size_t size) {
+#ifndef CANVAS_WRAP_MALLOC
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+#endif
+  if (size == 0) size = 1;
+  void* ptr = malloc(size);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+#endif
+
+extern "C" {
+  int64_t sk_debug_allocation_count() {
+#ifdef CANVAS_COUNT_ALLOCATIONS
+    return allocationCount.load(std::memory_order_relaxed);
+#else
+    return -1;
+#endif
+  }
+}
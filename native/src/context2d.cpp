@@ -3,8 +3,15 @@
 #include "include/core/SkMatrix.h"
 #include "include/core/SkPaint.h"
 #include "include/core/SkBitmap.h"
+#include <climits>
 #include <iostream>
 #include <vector>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
 #include "include/core/SkFontMgr.h"
 #include "include/core/SkColorSpace.h"
 #include "include/core/SkBlurTypes.h"
@@ -16,7 +23,11 @@
 #include "include/effects/SkColorMatrix.h"
 #include "include/effects/SkDashPathEffect.h"
 #include "include/effects/SkImageFilters.h"
+#include "include/font.hpp"
 #include "include/path2d.hpp"
+#include "include/stream.hpp"
+#include "include/textcache.hpp"
+#include "modules/skshaper/include/SkShaper.h"
 #include "include/core/SkMaskFilter.h"
 #include "deps/csscolorparser.hpp"
 
@@ -25,184 +36,134 @@
 #include <math.h>
 #endif
 
-extern sk_sp<skia::textlayout::FontCollection> fontCollection;
+// Most interned font families, see set_font_family
+#define FONT_FAMILY_INTERN_LIMIT 1024
 
-void free_style(Style* style) {
-  if (style->shader != nullptr) {
-    style->shader->unref();
-  }
-}
-
-void free_font(Font* font) {
-  free(font->family);
-  free(font);
+static FontFamily split_font_family(const char* family) {
+  SkTArray<SkString> split;
+  SkStrSplit(family, ",", &split);
+  return FontFamily { family, std::vector<SkString>(split.begin(), split.end()) };
 }
 
-Style clone_style(Style* style) {
-  Style new_style;
-  new_style.type = style->type;
-  if (style->type == kStyleColor) {
-    new_style.color = style->color;
-  } else if (style->type == kStyleShader) {
-    new_style.shader = sk_sp(style->shader);
+// Font families are interned along with their split family list, so that
+// states can share them, be copied without allocating and text calls don't
+// have to split the string again. Interned families are never freed, so once
+// the table is full (e.g. a document generating family names), further
+// families are owned by the states using them instead.
+void set_font_family(Font* font, const char* family) {
+  static std::unordered_map<std::string, FontFamily> families;
+  static std::mutex mutex;
+  std::unique_lock<std::mutex> lock(mutex);
+  auto it = families.find(family);
+  if (it == families.end()) {
+    if (families.size() >= FONT_FAMILY_INTERN_LIMIT) {
+      lock.unlock();
+      auto owned = std::make_shared<const FontFamily>(split_font_family(family));
+      font->family = owned->name.c_str();
+      font->families = &owned->families;
+      font->uninterned = std::move(owned);
+      return;
+    }
+    it = families.emplace(family, split_font_family(family)).first;
   }
-  return new_style;
+  font->family = it->second.name.c_str();
+  font->families = &it->second.families;
+  font->uninterned = nullptr;
 }
 
-sk_context_state* create_default_state() {
-  sk_context_state* state = new sk_context_state();
-  state->paint = new SkPaint();
-  state->paint->setAntiAlias(true);
+void init_default_state(sk_context_state* state) {
+  state->paint.setAntiAlias(true);
   state->shadowOffsetX = 0;
   state->shadowOffsetY = 0;
   state->shadowBlur = 0;
-  state->lineDash = std::vector<float>();
   state->globalAlpha = 1;
   state->lineDashOffset = 0;
-  state->fillStyle = Style();
   state->fillStyle.type = kStyleColor;
   state->fillStyle.color = { 0, 0, 0, 255 };
-  state->strokeStyle = Style();
   state->strokeStyle.type = kStyleColor;
   state->strokeStyle.color = { 0, 0, 0, 255 };
   state->shadowColor = {0, 0, 0, 255};
-  state->transform = new SkMatrix();
-  state->transform->setIdentity();
+  state->transform.setIdentity();
   state->imageSmoothingEnabled = true;
   state->imageSmoothingQuality = kLow;
   state->textAlign = kStart;
   state->textBaseline = kAlphabetic;
   state->direction = kInherit;
-  state->font = new Font();
-  state->font->size = 10;
-  state->font->family = strdup("sans-serif");
-  state->font->weight = 400;
-  state->font->style = FontStyle::kNormalStyle;
-  state->font->variant = FontVariant::kNormalVariant;
-  state->font->stretch = FontStretch::kNormal;
-  state->filter = sk_sp((SkImageFilter*)(nullptr));
+  state->font.size = 10;
+  set_font_family(&state->font, "sans-serif");
+  state->font.weight = 400;
+  state->font.style = FontStyle::kNormalStyle;
+  state->font.variant = FontVariant::kNormalVariant;
+  state->font.stretch = FontStretch::kNormal;
   state->letterSpacing = 0;
   state->wordSpacing = 0;
-  return state;
-}
-
-sk_context_state* clone_context_state(sk_context_state* state) {
-  sk_context_state* new_state = new sk_context_state();
-  new_state->paint = new SkPaint(*state->paint);
-  new_state->shadowOffsetX = state->shadowOffsetX;
-  new_state->shadowOffsetY = state->shadowOffsetY;
-  new_state->shadowBlur = state->shadowBlur;
-  new_state->lineDash = state->lineDash;
-  new_state->globalAlpha = state->globalAlpha;
-  new_state->lineDashOffset = state->lineDashOffset;
-  new_state->fillStyle = clone_style(&state->fillStyle);
-  new_state->strokeStyle = clone_style(&state->strokeStyle);
-  new_state->shadowColor = state->shadowColor;
-  new_state->transform = new SkMatrix(*state->transform);
-  new_state->imageSmoothingEnabled = state->imageSmoothingEnabled;
-  new_state->imageSmoothingQuality = state->imageSmoothingQuality;
-  new_state->textAlign = state->textAlign;
-  new_state->textBaseline = state->textBaseline;
-  new_state->direction = state->direction;
-  new_state->font = new Font();
-  new_state->font->size = state->font->size;
-  new_state->font->family = strdup(state->font->family);
-  new_state->font->weight = state->font->weight;
-  new_state->font->style = state->font->style;
-  new_state->font->variant = state->font->variant;
-  new_state->font->stretch = state->font->stretch;
-  new_state->filter = state->filter;
-  new_state->letterSpacing = state->letterSpacing;
-  new_state->wordSpacing = state->wordSpacing;
-  return new_state;
 }
 
-void free_context_state(sk_context_state* state) {
-  free_style(&state->fillStyle);
-  free_style(&state->strokeStyle);
-  if (state->filter.get() != nullptr) state->filter->unref();
-  delete state->paint;
-  delete state->transform;
-  free_font(state->font);
+sk_context* create_context(SkCanvas* canvas) {
+  sk_context* context = new sk_context();
+  context->canvas = canvas;
+  context->path = new SkPath();
+  // Deep save() nesting is rare, this avoids growing the stack in practice
+  context->states.reserve(16);
+  init_default_state(&context->states.emplace_back());
+  context->state = &context->states.back();
+  context->paintsDirty = true;
+  return context;
 }
 
 // Utility
 
-SkPaint* sk_context_fill_paint(sk_context_state* state) {
-  SkPaint* paint = new SkPaint(*state->paint);
-  paint->setStyle(SkPaint::kFill_Style);
-  if (state->fillStyle.type == kStyleColor) {
-    auto color = state->fillStyle.color;
-    paint->setColor(SkColorSetARGB(color.a, color.r, color.g, color.b));
-  } else if (state->fillStyle.type == kStyleShader) {
-    paint->setColor(SkColorSetARGB(paint->getAlpha(), 0, 0, 0));
-    paint->setShader(state->fillStyle.shader);
-  }
-  if (!state->lineDash.empty()) {
-    auto effect = SkDashPathEffect::Make(
-      state->lineDash.data(),
-      state->lineDash.size(),
+void sk_context_update_dash(sk_context* context) {
+  auto state = context->state;
+  if (state->lineDash == nullptr || state->lineDash->empty()) {
+    state->dashEffect = nullptr;
+  } else {
+    state->dashEffect = SkDashPathEffect::Make(
+      state->lineDash->data(),
+      state->lineDash->size(),
       state->lineDashOffset
     );
-    paint->setPathEffect(effect);
-  }
-  if (state->filter.get() != nullptr) {
-    paint->setImageFilter(state->filter);
   }
-  return paint;
+  context->paintsDirty = true;
 }
 
-SkPaint* sk_context_stroke_paint(sk_context_state* state) {
-  SkPaint* paint = new SkPaint(*state->paint);
-  paint->setStyle(SkPaint::kStroke_Style);
-  if (state->strokeStyle.type == kStyleColor) {
-    auto color = state->strokeStyle.color;
+void sk_context_style_paint(sk_context_state* state, Style* style, SkPaint* paint) {
+  if (style->type == kStyleColor) {
+    auto color = style->color;
     paint->setColor(SkColorSetARGB(color.a, color.r, color.g, color.b));
-  } else if (state->strokeStyle.type == kStyleShader) {
+  } else if (style->type == kStyleShader) {
     paint->setColor(SkColorSetARGB(paint->getAlpha(), 0, 0, 0));
-    paint->setShader(state->strokeStyle.shader);
-  }
-  if (!state->lineDash.empty()) {
-    auto effect = SkDashPathEffect::Make(
-      state->lineDash.data(),
-      state->lineDash.size(),
-      state->lineDashOffset
-    );
-    paint->setPathEffect(effect);
-  }
-  if (state->filter.get() != nullptr) {
-    paint->setImageFilter(state->filter);
+    paint->setShader(style->shader);
   }
-  return paint;
+  paint->setPathEffect(state->dashEffect);
+  paint->setImageFilter(state->filter);
 }
 
-SkPaint* sk_context_drop_shadow_paint(sk_context* context, SkPaint* paint) {
-  auto alpha = paint->getAlpha();
-  auto lastState = context->state;
-  auto shadowColor = lastState->shadowColor;
+void sk_context_drop_shadow_paint(sk_context_state* state, SkVector scale, const SkPaint& paint, std::optional<SkPaint>* result) {
+  result->reset();
+  auto alpha = paint.getAlpha();
+  auto shadowColor = state->shadowColor;
   auto shadowAlpha = shadowColor.a;
   shadowAlpha = (uint8_t)((((float) shadowAlpha) * ((float) alpha)) / 255);
-  if (shadowAlpha == 0) return nullptr;
-  if (lastState->shadowBlur == 0 && lastState->shadowOffsetX == 0 && lastState->shadowOffsetY == 0) return nullptr;
-  auto result = new SkPaint(*paint);
+  if (shadowAlpha == 0) return;
+  if (state->shadowBlur == 0 && state->shadowOffsetX == 0 && state->shadowOffsetY == 0) return;
+  auto& shadowPaint = result->emplace(paint);
   auto a = shadowColor.a;
   auto r = shadowColor.r;
   auto g = shadowColor.g;
   auto b = shadowColor.b;
-  auto ts = lastState->transform;
-  auto sigX = lastState->shadowBlur / (2.0f * ts->getScaleX());
-  auto sigY = lastState->shadowBlur / (2.0f * ts->getScaleY());
+  auto sigX = state->shadowBlur / (2.0f * scale.fX);
+  auto sigY = state->shadowBlur / (2.0f * scale.fY);
   auto shadowEffect = SkImageFilters::DropShadowOnly(
-    lastState->shadowOffsetX,
-    lastState->shadowOffsetY,
+    state->shadowOffsetX,
+    state->shadowOffsetY,
     sigX,
     sigY,
     SkColorSetARGB(a, r, g, b),
     nullptr
   );
-  result->setAlpha(shadowAlpha);
-  result->setImageFilter(shadowEffect);
-  return result;
+  shadowPaint.setAlpha(shadowAlpha);
+  shadowPaint.setImageFilter(shadowEffect);
 }
 
 RGBA multiplyByAlpha(RGBA* color, uint8_t globalAlpha) {
@@ -213,21 +174,20 @@ RGBA multiplyByAlpha(RGBA* color, uint8_t globalAlpha) {
   return result;
 }
 
-SkPaint* sk_context_shadow_blur_paint(sk_context* context, SkPaint* paint) {
-  auto alpha = paint->getAlpha();
-  auto lastState = context->state;
-  auto shadowColor = multiplyByAlpha(&lastState->shadowColor, alpha);
+void sk_context_shadow_blur_paint(sk_context_state* state, SkVector scale, const SkPaint& paint, std::optional<SkPaint>* result) {
+  result->reset();
+  auto alpha = paint.getAlpha();
+  auto shadowColor = multiplyByAlpha(&state->shadowColor, alpha);
   auto shadowAlpha = shadowColor.a;
-  if (shadowAlpha == 0) return nullptr;
-  if (lastState->shadowBlur == 0 && lastState->shadowOffsetX == 0 && lastState->shadowOffsetY == 0) return nullptr;
-  auto result = new SkPaint(*paint);
+  if (shadowAlpha == 0) return;
+  if (state->shadowBlur == 0 && state->shadowOffsetX == 0 && state->shadowOffsetY == 0) return;
+  auto& shadowPaint = result->emplace(paint);
   auto a = shadowColor.a;
   auto r = shadowColor.r;
   auto g = shadowColor.g;
   auto b = shadowColor.b;
-  auto ts = lastState->transform;
-  auto sigX = lastState->shadowBlur / (2.0f * ts->getScaleX());
-  auto sigY = lastState->shadowBlur / (2.0f * ts->getScaleY());
+  auto sigX = state->shadowBlur / (2.0f * scale.fX);
+  auto sigY = state->shadowBlur / (2.0f * scale.fY);
   auto shadowEffect = SkImageFilters::DropShadow(
     0.0f,
     0.0f,
@@ -236,11 +196,75 @@ SkPaint* sk_context_shadow_blur_paint(sk_context* context, SkPaint* paint) {
     SkColorSetARGB(a, r, g, b),
     nullptr
   );
-  result->setAlpha(shadowAlpha);
-  result->setImageFilter(shadowEffect);
-  auto blurEffect = SkMaskFilter::MakeBlur(SkBlurStyle::kNormal_SkBlurStyle, lastState->shadowBlur / 2.0f, false);
-  result->setMaskFilter(blurEffect);
-  return result;
+  shadowPaint.setAlpha(shadowAlpha);
+  shadowPaint.setImageFilter(shadowEffect);
+  auto blurEffect = SkMaskFilter::MakeBlur(SkBlurStyle::kNormal_SkBlurStyle, state->shadowBlur / 2.0f, false);
+  shadowPaint.setMaskFilter(blurEffect);
+}
+
+// Fill, stroke and shadow paints are derived from the current state once and
+// cached on the context, so drawing doesn't allocate. Setters affecting them,
+// and restore(), set paintsDirty; shadow blur also depends on the CTM scale,
+// which is compared instead.
+void sk_context_update_paints(sk_context* context) {
+  auto state = context->state;
+  auto ts = &state->transform;
+  auto scale = SkVector::Make(ts->getScaleX(), ts->getScaleY());
+  if (!context->paintsDirty && scale == context->shadowScale) return;
+
+  if (context->paintsDirty) {
+    context->fillPaint = state->paint;
+    context->fillPaint.setStyle(SkPaint::kFill_Style);
+    sk_context_style_paint(state, &state->fillStyle, &context->fillPaint);
+    context->strokePaint = state->paint;
+    context->strokePaint.setStyle(SkPaint::kStroke_Style);
+    sk_context_style_paint(state, &state->strokeStyle, &context->strokePaint);
+    context->paintsDirty = false;
+  }
+
+  context->shadowScale = scale;
+  sk_context_shadow_blur_paint(state, scale, context->fillPaint, &context->fillShadowPaint);
+  sk_context_shadow_blur_paint(state, scale, context->strokePaint, &context->strokeShadowPaint);
+  sk_context_drop_shadow_paint(state, scale, state->paint, &context->imageShadowPaint);
+}
+
+SkPaint* sk_context_fill_paint(sk_context* context) {
+  sk_context_update_paints(context);
+  return &context->fillPaint;
+}
+
+SkPaint* sk_context_stroke_paint(sk_context* context) {
+  sk_context_update_paints(context);
+  return &context->strokePaint;
+}
+
+// Shadow paint for fill() or stroke(), nullptr if nothing casts a shadow.
+SkPaint* sk_context_shadow_paint(sk_context* context, bool fill) {
+  sk_context_update_paints(context);
+  auto& shadowPaint = fill ? context->fillShadowPaint : context->strokeShadowPaint;
+  return shadowPaint ? &*shadowPaint : nullptr;
+}
+
+// Shadow paint for drawImage(), nullptr if nothing casts a shadow.
+SkPaint* sk_context_image_shadow_paint(sk_context* context) {
+  sk_context_update_paints(context);
+  auto& shadowPaint = context->imageShadowPaint;
+  return shadowPaint ? &*shadowPaint : nullptr;
+}
+
+// The current default path is built in device space: segments are mapped
+// through the CTM as they are added, so transform calls never have to touch
+// the accumulated path. It is mapped back into user space once per draw.
+SkPath* sk_context_user_path(sk_context* context) {
+  auto ts = &context->state->transform;
+  if (ts->isIdentity()) return context->path;
+  SkMatrix inverse;
+  if (!ts->invert(&inverse)) {
+    context->scratchPath.reset();
+    return &context->scratchPath;
+  }
+  context->path->transform(inverse, &context->scratchPath, SkApplyPerspectiveClip::kNo);
+  return &context->scratchPath;
 }
 
 void applyShadowOffsetMatrix(sk_context* context) {
@@ -251,17 +275,284 @@ void applyShadowOffsetMatrix(sk_context* context) {
   SkMatrix invert = SkMatrix::I();
   cts.invert(&invert);
   canvas->concat(invert);
-  auto shadowOffset = new SkMatrix(cts);
-  shadowOffset->preTranslate(shadowOffsetX, shadowOffsetY);
-  canvas->concat(*shadowOffset);
+  auto shadowOffset = cts;
+  shadowOffset.preTranslate(shadowOffsetX, shadowOffsetY);
+  canvas->concat(shadowOffset);
   canvas->concat(cts);
-  delete shadowOffset;
+}
+
+// Collects the output of SkShaper for a single run of glyphs.
+class SimpleRunHandler : public SkShaper::RunHandler {
+public:
+  std::vector<SkGlyphID> glyphs;
+  std::vector<SkPoint> positions;
+  SkFont font;
+  SkVector advance = { 0, 0 };
+  int runs = 0;
+
+  void beginLine() override {}
+  void runInfo(const RunInfo&) override {}
+  void commitRunInfo() override {}
+  Buffer runBuffer(const RunInfo& info) override {
+    runs++;
+    font = info.fFont;
+    glyphs.resize(info.glyphCount);
+    positions.resize(info.glyphCount);
+    return { glyphs.data(), positions.data(), nullptr, nullptr, { 0, 0 } };
+  }
+  void commitRunBuffer(const RunInfo& info) override {
+    advance = info.fAdvance;
+  }
+  void commitLine() override {}
+};
+
+// Whether text is printable ASCII/Latin-1, which never needs bidi, line
+// breaking or script itemization.
+bool sk_text_is_simple(const char* text, int textLen) {
+  auto bytes = (const uint8_t*) text;
+  for (int i = 0; i < textLen; i++) {
+    auto c = bytes[i];
+    if (c >= 0x20 && c < 0x7f) continue;
+    // U+00A0 to U+00FF
+    if ((c == 0xc2 && i + 1 < textLen && bytes[i + 1] >= 0xa0 && bytes[i + 1] <= 0xbf)
+      || (c == 0xc3 && i + 1 < textLen && bytes[i + 1] >= 0x80 && bytes[i + 1] <= 0xbf)) {
+      i++;
+      continue;
+    }
+    return false;
+  }
+  return true;
+}
+
+// Font used by the simple text fast path. Resolving it takes a typeface
+// lookup, so it is done lazily once per text call or measureText batch.
+typedef struct sk_simple_font {
+  bool resolved;
+  bool usable;
+  SkFont font;
+} sk_simple_font;
+
+void sk_context_resolve_simple_font(sk_context* context, sk_simple_font* simple) {
+  auto state = context->state;
+  simple->resolved = true;
+  simple->usable = false;
+  if (!sk_text_fast_path_enabled()) return;
+  if (state->direction == kRTL || state->letterSpacing != 0 || state->wordSpacing != 0) return;
+
+  auto fstyle = SkFontStyle(
+    state->font.weight,
+    state->font.stretch,
+    (SkFontStyle::Slant) state->font.style
+  );
+  auto typefaces = sk_font_collection()->findTypefaces(*state->font.families, fstyle);
+  if (typefaces.empty()) return;
+
+  // Same settings skparagraph shapes with
+  simple->font = SkFont(typefaces[0], state->font.size);
+  simple->font.setEdging(SkFont::Edging::kAntiAlias);
+  simple->font.setHinting(SkFontHinting::kSlight);
+  simple->font.setSubpixel(true);
+  simple->usable = true;
+}
+
+// Lays out short, simple, left-to-right text with a single typeface using
+// SkShaper directly, skipping skparagraph. Returns nullptr if the text
+// doesn't qualify, in which case the paragraph path is used.
+std::shared_ptr<sk_text_layout> sk_layout_simple_text(const SkFont& font, char* text, int textLen) {
+  if (textLen == 0 || !sk_text_is_simple(text, textLen)) return nullptr;
+
+  // Any missing glyph would need font fallback
+  thread_local std::vector<SkGlyphID> coverage;
+  coverage.resize(textLen);
+  auto count = font.textToGlyphs(text, textLen, SkTextEncoding::kUTF8, coverage.data(), textLen);
+  for (int i = 0; i < count; i++) {
+    if (coverage[i] == 0) return nullptr;
+  }
+
+  thread_local std::unique_ptr<SkShaper> shaper = SkShaper::MakeShapeDontWrapOrReorder();
+  SimpleRunHandler handler;
+  shaper->shape(text, textLen, font, true, SK_ScalarInfinity, &handler);
+  auto glyphsSize = handler.glyphs.size();
+  if (handler.runs != 1 || glyphsSize == 0) return nullptr;
+
+  auto layout = std::make_shared<sk_text_layout>();
+  SkTextBlobBuilder builder;
+  auto run = builder.allocRunPos(handler.font, glyphsSize);
+  memcpy(run.glyphs, handler.glyphs.data(), glyphsSize * sizeof(SkGlyphID));
+  memcpy(run.points(), handler.positions.data(), glyphsSize * sizeof(SkPoint));
+  layout->blob = builder.make();
+
+  auto metrics = &layout->fontMetrics;
+  handler.font.getMetrics(metrics);
+  // Line metrics as skparagraph computes them for a single line
+  layout->alphabeticBaseline = metrics->fLeading / 2 - metrics->fAscent;
+  layout->ideographicBaseline = metrics->fDescent - metrics->fAscent + metrics->fLeading;
+  layout->height = round(layout->ideographicBaseline);
+
+  std::vector<SkRect> bounds(glyphsSize);
+  handler.font.getBounds(handler.glyphs.data(), glyphsSize, bounds.data(), nullptr);
+  layout->width = handler.advance.fX;
+  layout->firstCharBounds = bounds[0];
+  layout->lastCharBounds = bounds[glyphsSize - 1];
+  layout->lastCharPosX = handler.positions[glyphsSize - 1].fX;
+  layout->lineLeft = 0;
+  layout->descent = bounds[0].fBottom;
+  layout->ascent = bounds[0].fTop;
+  for (size_t i = 1; i < glyphsSize; ++i) {
+    if (bounds[i].fBottom > layout->descent) layout->descent = bounds[i].fBottom;
+    if (bounds[i].fTop < layout->ascent) layout->ascent = bounds[i].fTop;
+  }
+  return layout;
+}
+
+// Paragraph builders own an SkUnicode instance, whose ICU setup is costly,
+// so each context keeps one and resets it between text calls. The paragraph
+// style is fixed at creation, so it is only recreated when the direction
+// changes; the font comes from the text style pushed for each call. It is
+// also recreated when the thread's font collection changes, which happens
+// after fonts are registered or when the context moves to another thread.
+skia::textlayout::ParagraphBuilder* sk_context_text_builder(sk_context* context, const skia::textlayout::TextStyle& tstyle) {
+  auto direction = context->state->direction == kRTL ? kRTL : kLTR;
+  auto& fonts = sk_font_collection();
+  if (context->textBuilder != nullptr && context->textBuilderDirection == direction && context->textBuilderFonts == fonts.get()) {
+    context->textBuilder->Reset();
+    return context->textBuilder;
+  }
+  skia::textlayout::ParagraphStyle paraStyle;
+  paraStyle.setTextAlign(skia::textlayout::TextAlign::kLeft);
+  paraStyle.setTextStyle(tstyle);
+  paraStyle.setTextDirection(skia::textlayout::TextDirection(direction == kRTL ? 0 : 1));
+  delete context->textBuilder;
+  context->textBuilder = skia::textlayout::ParagraphBuilderImpl::make(paraStyle, fonts, SkUnicode::Make()).release();
+  context->textBuilderDirection = direction;
+  context->textBuilderFonts = fonts.get();
+  return context->textBuilder;
+}
+
+// Shapes and lays out text with the font settings of the current state,
+// going through the text cache. Returns nullptr if nothing could be shaped.
+std::shared_ptr<sk_text_layout> sk_context_layout_text(sk_context* context, char* text, int textLen, sk_simple_font* simpleFont) {
+  auto state = context->state;
+  auto& key = sk_text_cache_key(state->font, state->letterSpacing, state->wordSpacing, state->direction, text, textLen);
+  auto cached = sk_text_cache_get(key);
+  if (cached != nullptr) return cached;
+
+  // Fonts can't be registered while shaping, the result only holds
+  // typefaces, so drawing it later needs no lock
+  std::shared_lock<std::shared_mutex> lock(fontLock);
+  if (!simpleFont->resolved) sk_context_resolve_simple_font(context, simpleFont);
+  if (simpleFont->usable) {
+    auto simple = sk_layout_simple_text(simpleFont->font, text, textLen);
+    if (simple != nullptr) {
+      sk_text_cache_put(key, simple, textLen);
+      return simple;
+    }
+  }
+
+  skia::textlayout::TextStyle tstyle;
+  tstyle.setTextBaseline(skia::textlayout::TextBaseline::kAlphabetic);
+  tstyle.setFontFamilies(*state->font.families);
+  tstyle.setFontSize(state->font.size);
+  tstyle.setWordSpacing(state->wordSpacing);
+  tstyle.setLetterSpacing(state->letterSpacing);
+  tstyle.setHeight(1);
+
+  auto fstyle = SkFontStyle(
+    state->font.weight,
+    state->font.stretch,
+    (SkFontStyle::Slant) state->font.style
+  );
+  tstyle.setFontStyle(fstyle);
+
+  auto builder = sk_context_text_builder(context, tstyle);
+  builder->pushStyle(tstyle);
+  builder->addText(text, textLen);
+  auto paragraph = builder->Build();
+  paragraph->layout(100000);
+
+  auto paragraphImpl = static_cast<skia::textlayout::ParagraphImpl *>(paragraph.get());
+
+  std::vector<skia::textlayout::LineMetrics> metrics_vec;
+  paragraph->getLineMetrics(metrics_vec);
+  if (metrics_vec.size() == 0) return nullptr;
+
+  auto run = paragraphImpl->run(0);
+  auto glyphs = run.glyphs();
+  auto glyphsSize = glyphs.size();
+  if (glyphsSize == 0) return nullptr;
+  auto font = run.font();
+
+  auto layout = std::make_shared<sk_text_layout>();
+  font.getMetrics(&layout->fontMetrics);
+
+  std::vector<SkRect> bounds(glyphsSize);
+  font.getBounds(glyphs.data(), glyphsSize, bounds.data(), nullptr);
+
+  auto textBox = paragraph->getRectsForRange(0, textLen, skia::textlayout::RectHeightStyle::kTight, skia::textlayout::RectWidthStyle::kTight);
+  layout->width = 0.0;
+  for (auto &box : textBox) {
+    layout->width += box.rect.width();
+  }
+
+  layout->firstCharBounds = bounds[0];
+  layout->lastCharBounds = bounds[glyphsSize - 1];
+  layout->lastCharPosX = run.positionX(glyphsSize - 1);
+  layout->lineLeft = metrics_vec[0].fLeft;
+  layout->descent = bounds[0].fBottom;
+  layout->ascent = bounds[0].fTop;
+  for (size_t i = 1; i < glyphsSize; ++i) {
+    if (bounds[i].fBottom > layout->descent) layout->descent = bounds[i].fBottom;
+    if (bounds[i].fTop < layout->ascent) layout->ascent = bounds[i].fTop;
+  }
+
+  layout->alphabeticBaseline = paragraph->getAlphabeticBaseline();
+  layout->ideographicBaseline = paragraph->getIdeographicBaseline();
+  layout->height = paragraph->getHeight();
+  layout->paragraph = std::move(paragraph);
+  sk_text_cache_put(key, layout, textLen);
+  return layout;
+}
+
+// Cursor over a command buffer passed to sk_context_execute.
+typedef struct sk_command_reader {
+  const uint8_t* cur;
+  const uint8_t* end;
+} sk_command_reader;
+
+bool command_read_u32(sk_command_reader* reader, uint32_t* out) {
+  if (reader->end - reader->cur < 4) return false;
+  memcpy(out, reader->cur, 4);
+  reader->cur += 4;
+  return true;
+}
+
+bool command_read_f32(sk_command_reader* reader, int count, float* out) {
+  if (reader->end - reader->cur < 4 * count) return false;
+  memcpy(out, reader->cur, 4 * count);
+  reader->cur += 4 * count;
+  return true;
+}
+
+// Strings are stored as a u32 byte length followed by the UTF-8 bytes and a
+// NUL terminator, padded to a multiple of 4 bytes. The length is checked
+// before use, as a corrupt buffer must not make callers read past the end.
+bool command_read_string(sk_command_reader* reader, char** out, int* outLen) {
+  uint32_t len;
+  if (!command_read_u32(reader, &len)) return false;
+  if (len > INT_MAX) return false;
+  size_t padded = ((size_t) len + 4) & ~(size_t) 3;
+  if ((size_t)(reader->end - reader->cur) < padded) return false;
+  if (reader->cur[len] != 0) return false;
+  *out = (char*) reader->cur;
+  *outLen = len;
+  reader->cur += padded;
+  return true;
 }
 
 extern "C" {
   /// Drawing rectangles
 
-  // Context.clearRect()
+  // Context.clearRect(), opaque canvases are cleared to black
   void sk_context_clear_rect(sk_context* context, float x, float y, float width, float height) {
     auto canvas = context->canvas;
     SkPaint paint;
@@ -269,6 +560,10 @@ extern "C" {
     paint.setStyle(SkPaint::kFill_Style);
     paint.setStrokeMiter(10.0f);
     paint.setBlendMode(SkBlendMode::kClear);
+    if (canvas->imageInfo().isOpaque()) {
+      paint.setColor(SK_ColorBLACK);
+      paint.setBlendMode(SkBlendMode::kSrc);
+    }
     canvas->drawRect(SkRect::MakeXYWH(x, y, width, height), paint);
   }
 
@@ -276,34 +571,30 @@ extern "C" {
   void sk_context_fill_rect(sk_context* context, float x, float y, float width, float height) {
     auto canvas = context->canvas;
     auto rect = SkRect::MakeXYWH(x, y, width, height);
-    auto fillPaint = sk_context_fill_paint(context->state);
-    auto shadowPaint = sk_context_shadow_blur_paint(context, fillPaint);
+    auto fillPaint = sk_context_fill_paint(context);
+    auto shadowPaint = sk_context_shadow_paint(context, true);
     if (shadowPaint != nullptr) {
       canvas->save();
       applyShadowOffsetMatrix(context);
       canvas->drawRect(rect, *shadowPaint);
       canvas->restore();
-      delete shadowPaint;
     }
     canvas->drawRect(rect, *fillPaint);
-    delete fillPaint;
   }
 
   // Context.strokeRect()
   void sk_context_stroke_rect(sk_context* context, float x, float y, float width, float height) {
     auto canvas = context->canvas;
     auto rect = SkRect::MakeXYWH(x, y, width, height);
-    auto strokePaint = sk_context_stroke_paint(context->state);
-    auto shadowPaint = sk_context_shadow_blur_paint(context, strokePaint);
+    auto strokePaint = sk_context_stroke_paint(context);
+    auto shadowPaint = sk_context_shadow_paint(context, false);
     if (shadowPaint != nullptr) {
       canvas->save();
       applyShadowOffsetMatrix(context);
       canvas->drawRect(rect, *shadowPaint);
       canvas->restore();
-      delete shadowPaint;
     }
     canvas->drawRect(rect, *strokePaint);
-    delete strokePaint;
   }
 
   /// Drawing text
@@ -317,84 +608,18 @@ extern "C" {
     float maxWidth,
     int fill,
     sk_line_metrics* out_metrics,
-    SkPaint* paint
+    SkPaint* paint,
+    sk_simple_font* simpleFont
   ) {
-    SkTArray<SkString> families;
-    SkStrSplit(context->state->font->family, ",", &families);
-    std::vector<SkString> familyVec;
-    for (auto& family : families) {
-      familyVec.emplace_back(family);
-    }
+    auto layout = sk_context_layout_text(context, text, textLen, simpleFont);
+    if (layout == nullptr) return 0;
+    auto paragraph = layout->paragraph.get();
+    auto font_metrics = layout->fontMetrics;
+    auto alphaBaseline = layout->alphabeticBaseline;
+    auto lineWidth = layout->width;
+    auto ascent = layout->ascent;
+    auto descent = layout->descent;
 
-    skia::textlayout::TextStyle tstyle;
-    tstyle.setTextBaseline(skia::textlayout::TextBaseline::kAlphabetic);
-    tstyle.setFontFamilies(familyVec);
-    tstyle.setFontSize(context->state->font->size);
-    tstyle.setWordSpacing(context->state->wordSpacing);
-    tstyle.setLetterSpacing(context->state->letterSpacing);
-    tstyle.setHeight(1);
-
-    auto fstyle = SkFontStyle(
-      context->state->font->weight,
-      context->state->font->stretch,
-      (SkFontStyle::Slant) context->state->font->style
-    );
-    tstyle.setFontStyle(fstyle);
-    tstyle.setForegroundColor(*paint);
-    
-    skia::textlayout::ParagraphStyle paraStyle;
-    paraStyle.setTextAlign(skia::textlayout::TextAlign::kLeft);
-    paraStyle.setTextStyle(tstyle);
-    paraStyle.setTextDirection(skia::textlayout::TextDirection(context->state->direction == kRTL ? 0 : 1));
-    
-    auto builder = skia::textlayout::ParagraphBuilderImpl::make(paraStyle, fontCollection, SkUnicode::Make());
-    builder->addText(text, textLen);
-    auto paragraph = builder->Build();
-    paragraph.get()->layout(100000);
-
-    auto paragraphImpl = static_cast<skia::textlayout::ParagraphImpl *>(paragraph.get());
-
-    std::vector<skia::textlayout::LineMetrics> metrics_vec;
-    paragraph->getLineMetrics(metrics_vec);
-    if (metrics_vec.size() == 0) return 0;
-    
-    auto line_metrics = metrics_vec[0];
-    auto run = paragraphImpl->run(0);
-    auto font = run.font();
-    
-    SkFontMetrics font_metrics;
-    font.getMetrics(&font_metrics);
-    
-    SkRect* bounds = (SkRect*) malloc(sizeof(SkRect) * textLen);
-    auto glyphs = run.glyphs();
-    auto glyphsSize = glyphs.size();
-    font.getBounds(glyphs.data(), textLen, &bounds[0], nullptr);
-    
-    auto textBox = paragraph->getRectsForRange(0, textLen, skia::textlayout::RectHeightStyle::kTight, skia::textlayout::RectWidthStyle::kTight);
-    double lineWidth = 0.0;
-    SkRect firstCharBounds = bounds[0];
-    SkScalar descent = firstCharBounds.fBottom;
-    SkScalar ascent = firstCharBounds.fTop;
-    SkRect lastCharBounds = bounds[glyphsSize - 1];
-    float lastCharPosX = run.positionX(glyphsSize - 1);
-    
-    for (auto &box : textBox) {
-      lineWidth += box.rect.width();
-    }
-    
-    for (size_t i = 1; i <= glyphsSize - 1; ++i) {
-      auto charBounds = bounds[i];
-      auto charBottom = charBounds.fBottom;
-      if (charBottom > descent) {
-        descent = charBottom;
-      }
-      auto charTop = charBounds.fTop;
-      if (charTop < ascent) {
-        ascent = charTop;
-      }
-    }
-    
-    auto alphaBaseline = paragraph->getAlphabeticBaseline();
     auto cssBaseline = (CssBaseline) context->state->textBaseline;
     
     SkScalar baselineOffset = 0;
@@ -406,13 +631,13 @@ extern "C" {
       baselineOffset = -alphaBaseline - font_metrics.fAscent * 80 / 100.0;
       break;
     case CssBaseline::Middle:
-      baselineOffset = -paragraph->getHeight() / 2;
+      baselineOffset = -layout->height / 2;
       break;
     case CssBaseline::Alphabetic:
       baselineOffset = -alphaBaseline;
       break;
     case CssBaseline::Ideographic:
-      baselineOffset = -paragraph->getIdeographicBaseline();
+      baselineOffset = -layout->ideographicBaseline;
       break;
     case CssBaseline::Bottom:
       baselineOffset = font_metrics.fStrikeoutThickness + font_metrics.fStrikeoutPosition - alphaBaseline;
@@ -443,14 +668,14 @@ extern "C" {
       auto offset = -baselineOffset - alphaBaseline;
       out_metrics->ascent = -ascent + offset;
       out_metrics->descent = descent + offset;
-      out_metrics->left = -paintX + line_metrics.fLeft - firstCharBounds.fLeft;
-      out_metrics->right = paintX + lastCharPosX + lastCharBounds.fRight - line_metrics.fLeft;
+      out_metrics->left = -paintX + layout->lineLeft - layout->firstCharBounds.fLeft;
+      out_metrics->right = paintX + layout->lastCharPosX + layout->lastCharBounds.fRight - layout->lineLeft;
       out_metrics->width = lineWidth;
       out_metrics->font_ascent = -font_metrics.fAscent + offset;
       out_metrics->font_descent = font_metrics.fDescent + offset;
       out_metrics->alphabetic_baseline = -font_metrics.fAscent + offset;
-      out_metrics->ideographic_baseline = -paragraph->getIdeographicBaseline() + offset;
-      out_metrics->hanging_baseline = -paragraph->getAlphabeticBaseline() + offset;
+      out_metrics->ideographic_baseline = -layout->ideographicBaseline + offset;
+      out_metrics->hanging_baseline = -alphaBaseline + offset;
     } else {
       auto needScale = lineWidth > maxWidth;
       auto ratio = needScale ? maxWidth / lineWidth : 1.0;
@@ -459,13 +684,17 @@ extern "C" {
         context->canvas->scale(ratio, 1.0);
       }
       auto paintY = y + baselineOffset;
-      paragraph.get()->paint(context->canvas, paintX / ratio, paintY);
+      if (paragraph != nullptr) {
+        paragraph->updateForegroundPaint(0, textLen, *paint);
+        paragraph->paint(context->canvas, paintX / ratio, paintY);
+      } else {
+        context->canvas->drawTextBlob(layout->blob, paintX / ratio, paintY + alphaBaseline, *paint);
+      }
       if (needScale) {
         context->canvas->restore();
       }
     }
 
-    free(bounds);
     return 1;
   }
 
@@ -478,9 +707,10 @@ extern "C" {
     int fill,
     sk_line_metrics* out_metrics
   ) {
-    auto paint = fill == 1 ? sk_context_fill_paint(context->state) : sk_context_stroke_paint(context->state);
+    auto paint = fill == 1 ? sk_context_fill_paint(context) : sk_context_stroke_paint(context);
+    sk_simple_font simpleFont = {};
     if (out_metrics == nullptr) {
-      auto shadowPaint = sk_context_shadow_blur_paint(context, paint);
+      auto shadowPaint = sk_context_shadow_paint(context, fill == 1);
       if (shadowPaint != nullptr) {
         context->canvas->save();
         applyShadowOffsetMatrix(context);
@@ -493,10 +723,10 @@ extern "C" {
           maxWidth,
           fill,
           nullptr,
-          shadowPaint
+          shadowPaint,
+          &simpleFont
         );
         context->canvas->restore();
-        delete shadowPaint;
         if (res == 0) return 0;
       }
     }
@@ -509,12 +739,27 @@ extern "C" {
       maxWidth,
       fill,
       out_metrics,
-      paint
+      paint,
+      &simpleFont
     );
-    delete paint;
     return res;
   }
 
+  // Context.measureTextBatch() (non-standard)
+  // Measures count strings with the current font. String i is the UTF-8
+  // range offsets[i]..offsets[i + 1] of utf8, so offsets has count + 1
+  // entries. Strings that can't be measured get zeroed metrics.
+  void sk_context_measure_text_batch(sk_context* context, const char* utf8, const uint32_t* offsets, int count, sk_line_metrics* out) {
+    sk_simple_font simpleFont = {};
+    for (int i = 0; i < count; i++) {
+      auto text = (char*) utf8 + offsets[i];
+      int textLen = offsets[i + 1] - offsets[i];
+      if (textLen == 0 || !sk_context_text_base(context, text, textLen, 0, 0, 100000, 1, &out[i], nullptr, &simpleFont)) {
+        memset(&out[i], 0, sizeof(sk_line_metrics));
+      }
+    }
+  }
+
   // Context.fillText() implementation in JS using sk_context_text
   // Context.strokeText() implementation in JS using sk_context_text
   // Context.measureText() implementation in JS using sk_context_text
@@ -523,17 +768,18 @@ extern "C" {
 
   // Context.lineWidth getter
   float sk_context_get_line_width(sk_context* context) {
-    return context->state->paint->getStrokeWidth();
+    return context->state->paint.getStrokeWidth();
   }
 
   // Context.lineWidth setter
   void sk_context_set_line_width(sk_context* context, float width) {
-    context->state->paint->setStrokeWidth(width);
+    context->paintsDirty = true;
+    context->state->paint.setStrokeWidth(width);
   }
 
   // Context.lineCap getter
   int sk_context_get_line_cap(sk_context* context) {
-    auto cap = context->state->paint->getStrokeCap();
+    auto cap = context->state->paint.getStrokeCap();
     switch (cap) {
       case SkPaint::kButt_Cap:
         return 0;
@@ -546,22 +792,23 @@ extern "C" {
 
   // Context.lineCap setter
   void sk_context_set_line_cap(sk_context* context, int cap) {
+    context->paintsDirty = true;
     switch (cap) {
       case 0:
-        context->state->paint->setStrokeCap(SkPaint::kButt_Cap);
+        context->state->paint.setStrokeCap(SkPaint::kButt_Cap);
         break;
       case 1:
-        context->state->paint->setStrokeCap(SkPaint::kRound_Cap);
+        context->state->paint.setStrokeCap(SkPaint::kRound_Cap);
         break;
       case 2:
-        context->state->paint->setStrokeCap(SkPaint::kSquare_Cap);
+        context->state->paint.setStrokeCap(SkPaint::kSquare_Cap);
         break;
     }
   }
 
   // Context.lineJoin getter
   int sk_context_get_line_join(sk_context* context) {
-    auto join = context->state->paint->getStrokeJoin();
+    auto join = context->state->paint.getStrokeJoin();
     switch (join) {
       case SkPaint::kMiter_Join:
         return 0;
@@ -574,34 +821,37 @@ extern "C" {
 
   // Context.lineJoin setter
   void sk_context_set_line_join(sk_context* context, int join) {
+    context->paintsDirty = true;
     switch (join) {
       case 0:
-        context->state->paint->setStrokeJoin(SkPaint::kMiter_Join);
+        context->state->paint.setStrokeJoin(SkPaint::kMiter_Join);
         break;
       case 1:
-        context->state->paint->setStrokeJoin(SkPaint::kRound_Join);
+        context->state->paint.setStrokeJoin(SkPaint::kRound_Join);
         break;
       case 2:
-        context->state->paint->setStrokeJoin(SkPaint::kBevel_Join);
+        context->state->paint.setStrokeJoin(SkPaint::kBevel_Join);
         break;
     }
   }
 
   // Context.miterLimit getter
   float sk_context_get_miter_limit(sk_context* context) {
-    return context->state->paint->getStrokeMiter();
+    return context->state->paint.getStrokeMiter();
   }
 
   // Context.miterLimit setter
   void sk_context_set_miter_limit(sk_context* context, float limit) {
-    context->state->paint->setStrokeMiter(limit);
+    context->paintsDirty = true;
+    context->state->paint.setStrokeMiter(limit);
   }
 
   // Context.getLineDash() value is cached in JS side
 
   // Context.setLineDash()
   void sk_context_set_line_dash(sk_context* context, float* dash, int count) {
-    context->state->lineDash = std::vector<float>(dash, dash + count);
+    context->state->lineDash = std::make_shared<const std::vector<float>>(dash, dash + count);
+    sk_context_update_dash(context);
   }
 
   // Context.lineDashOffset getter
@@ -612,6 +862,7 @@ extern "C" {
   // Context.lineDashOffset setter
   void sk_context_set_line_dash_offset(sk_context* context, float offset) {
     context->state->lineDashOffset = offset;
+    sk_context_update_dash(context);
   }
 
   /// Text styles
@@ -619,7 +870,10 @@ extern "C" {
   // Context.font getter value is cached in JS side
 
   // Context.font setter (Font string parsed in JS side)
-  void sk_context_set_font(
+  // Returns 0 and leaves the font unchanged if it is rejected. Keep in sync
+  // with isValidFont in src/context2d.ts, which checks the same before
+  // recording batched font changes.
+  int sk_context_set_font(
     sk_context* context,
     float size,
     char* family,
@@ -628,14 +882,14 @@ extern "C" {
     int variant,
     int stretch
   ) {
-    free_font(context->state->font);
-    context->state->font = new Font();
-    context->state->font->family = strdup(family);
-    context->state->font->size = size;
-    context->state->font->weight = weight;
-    context->state->font->style = FontStyle(style);
-    context->state->font->variant = FontVariant(variant);
-    context->state->font->stretch = FontStretch(stretch);
+    if (family == nullptr || *family == 0 || !SkScalarIsFinite(size) || size < 0) return 0;
+    set_font_family(&context->state->font, family);
+    context->state->font.size = size;
+    context->state->font.weight = weight;
+    context->state->font.style = FontStyle(style);
+    context->state->font.variant = FontVariant(variant);
+    context->state->font.stretch = FontStretch(stretch);
+    return 1;
   }
 
   // Context.textAlign getter
@@ -682,12 +936,12 @@ extern "C" {
 
   // Context.fontStretch setter
   void sk_context_set_font_stretch(sk_context* context, int stretch) {
-    context->state->font->stretch = FontStretch(stretch);
+    context->state->font.stretch = FontStretch(stretch);
   }
 
   // Context.fontVariantCaps setter
   void sk_context_set_font_variant_caps(sk_context* context, int caps) {
-    context->state->font->variant = FontVariant(caps);
+    context->state->font.variant = FontVariant(caps);
   }
 
   // Context.textRendering() stubbed in JS side
@@ -710,25 +964,25 @@ extern "C" {
   int sk_context_set_fill_style(sk_context* context, char* style) {
     auto color = CSSColorParser::parse(std::string(style));
     if (color) {
-      free_style(&context->state->fillStyle);
       auto val = color.value();
       context->state->fillStyle = Style();
       context->state->fillStyle.type = kStyleColor;
       context->state->fillStyle.color = {val.r, val.g, val.b, (uint8_t)(val.a * 255)};
+      context->paintsDirty = true;
       return 1;
     }
     return 0;
   }
 
   void sk_context_set_fill_style_gradient(sk_context* context, sk_gradient* gradient) {
-    free_style(&context->state->fillStyle);
+    context->paintsDirty = true;
     context->state->fillStyle = Style();
     context->state->fillStyle.type = kStyleShader;
-    context->state->fillStyle.shader = sk_gradient_to_shader(gradient, context->state->transform);
+    context->state->fillStyle.shader = sk_gradient_to_shader(gradient, &context->state->transform);
   }
 
   void sk_context_set_fill_style_pattern(sk_context* context, sk_pattern* pattern) {
-    free_style(&context->state->fillStyle);
+    context->paintsDirty = true;
     context->state->fillStyle = Style();
     context->state->fillStyle.type = kStyleShader;
     context->state->fillStyle.shader = sk_pattern_to_shader(pattern);
@@ -740,25 +994,25 @@ extern "C" {
   int sk_context_set_stroke_style(sk_context* context, char* style) {
     auto color = CSSColorParser::parse(std::string(style));
     if (color) {
-      free_style(&context->state->strokeStyle);
       auto val = color.value();
       context->state->strokeStyle = Style();
       context->state->strokeStyle.type = kStyleColor;
       context->state->strokeStyle.color = {val.r, val.g, val.b, (uint8_t)(val.a * 255)};
+      context->paintsDirty = true;
       return 1;
     }
     return 0;
   }
 
   void sk_context_set_stroke_style_gradient(sk_context* context, sk_gradient* gradient) {
-    free_style(&context->state->strokeStyle);
+    context->paintsDirty = true;
     context->state->strokeStyle = Style();
     context->state->strokeStyle.type = kStyleShader;
-    context->state->strokeStyle.shader = sk_gradient_to_shader(gradient, context->state->transform);
+    context->state->strokeStyle.shader = sk_gradient_to_shader(gradient, &context->state->transform);
   }
 
   void sk_context_set_stroke_style_pattern(sk_context* context, sk_pattern* pattern) {
-    free_style(&context->state->strokeStyle);
+    context->paintsDirty = true;
     context->state->strokeStyle = Style();
     context->state->strokeStyle.type = kStyleShader;
     context->state->strokeStyle.shader = sk_pattern_to_shader(pattern);
@@ -783,6 +1037,7 @@ extern "C" {
 
   // Context.shadowBlur setter
   void sk_context_set_shadow_blur(sk_context* context, float blur) {
+    context->paintsDirty = true;
     context->state->shadowBlur = blur;
   }
 
@@ -794,6 +1049,7 @@ extern "C" {
     if (color) {
       auto val = color.value();
       context->state->shadowColor = {val.r, val.g, val.b, (uint8_t)(val.a * 255)};
+      context->paintsDirty = true;
       return 1;
     }
     return 0;
@@ -806,6 +1062,7 @@ extern "C" {
 
   // Context.shadowOffsetX setter
   void sk_context_set_shadow_offset_x(sk_context* context, float x) {
+    context->paintsDirty = true;
     context->state->shadowOffsetX = x;
   }
 
@@ -816,6 +1073,7 @@ extern "C" {
 
   // Context.shadowOffsetY setter
   void sk_context_set_shadow_offset_y(sk_context* context, float y) {
+    context->paintsDirty = true;
     context->state->shadowOffsetY = y;
   }
 
@@ -831,86 +1089,121 @@ extern "C" {
     context->path->close();
   }
 
+  // Path segments are mapped through the current transform as they are
+  // added, see sk_context_user_path.
+
   // Context.moveTo()
   void sk_context_move_to(sk_context* context, float x, float y) {
-    sk_path_move_to(context->path, x, y);
+    context->path->moveTo(context->state->transform.mapXY(x, y));
   }
 
   // Context.lineTo()
   void sk_context_line_to(sk_context* context, float x, float y) {
-    sk_path_line_to(context->path, x, y);
+    context->path->lineTo(context->state->transform.mapXY(x, y));
   }
 
   // Context.bezierCurveTo()
   void sk_context_bezier_curve_to(sk_context* context, float cp1x, float cp1y, float cp2x, float cp2y, float x, float y) {
-    sk_path_bezier_curve_to(context->path, cp1x, cp1y, cp2x, cp2y, x, y);
+    SkPoint pts[3] = { { cp1x, cp1y }, { cp2x, cp2y }, { x, y } };
+    context->state->transform.mapPoints(pts, 3);
+    context->path->cubicTo(pts[0], pts[1], pts[2]);
   }
 
   // Context.quadraticCurveTo()
   void sk_context_quadratic_curve_to(sk_context* context, float cpx, float cpy, float x, float y) {
-    sk_path_quadratic_curve_to(context->path, cpx, cpy, x, y);
+    SkPoint pts[2] = { { cpx, cpy }, { x, y } };
+    context->state->transform.mapPoints(pts, 2);
+    context->path->quadTo(pts[0], pts[1]);
   }
-  
+
+  // Context.ellipse()
+  void sk_context_ellipse(sk_context* context, float x, float y, float radiusX, float radiusY, float rotation, float startAngle, float endAngle, bool clockwise) {
+    sk_path_add_ellipse(context->path, context->state->transform, x, y, radiusX, radiusY, rotation, startAngle, endAngle, clockwise);
+  }
+
   // Context.arc()
   void sk_context_arc(sk_context* context, float x, float y, float radius, float startAngle, float endAngle, bool clockwise) {
-    sk_path_arc(context->path, x, y, radius, startAngle, endAngle, clockwise);
+    sk_context_ellipse(context, x, y, radius, radius, 0, startAngle, endAngle, clockwise);
   }
 
   // Context.arcTo()
   void sk_context_arc_to(sk_context* context, float x1, float y1, float x2, float y2, float radius) {
-    sk_path_arc_to(context->path, x1, y1, x2, y2, radius);
-  }
-
-  // Context.ellipse()
-  void sk_context_ellipse(sk_context* context, float x, float y, float radiusX, float radiusY, float rotation, float startAngle, float endAngle, bool clockwise) {
-    sk_path_ellipse(context->path, x, y, radiusX, radiusY, rotation, startAngle, endAngle, clockwise);
+    auto ts = &context->state->transform;
+    if (ts->isIdentity()) {
+      sk_path_arc_to(context->path, x1, y1, x2, y2, radius);
+      return;
+    }
+    SkMatrix inverse;
+    if (!ts->invert(&inverse)) return;
+    // The tangents depend on the current point, which has to be brought
+    // back into user space first
+    auto scratch = &context->scratchPath;
+    scratch->rewind();
+    SkPoint last;
+    if (context->path->getLastPt(&last)) {
+      scratch->moveTo(inverse.mapXY(last.fX, last.fY));
+    } else {
+      scratch->moveTo(x1, y1);
+    }
+    scratch->arcTo(x1, y1, x2, y2, radius);
+    context->path->addPath(*scratch, *ts, SkPath::kExtend_AddPathMode);
   }
 
   // Context.rect()
   void sk_context_rect(sk_context* context, float x, float y, float width, float height) {
-    sk_path_rect(context->path, x, y, width, height);
+    SkPoint pts[4] = { { x, y }, { x + width, y }, { x + width, y + height }, { x, y + height } };
+    context->state->transform.mapPoints(pts, 4);
+    context->path->addPoly(pts, 4, true);
   }
 
   // Context.roundRect()
   void sk_context_round_rect(sk_context* context, float x, float y, float width, float height, float tl, float tr, float br, float bl) {
-    sk_path_round_rect(context->path, x, y, width, height, tl, tr, br, bl);
+    auto ts = &context->state->transform;
+    if (ts->isIdentity()) {
+      sk_path_round_rect(context->path, x, y, width, height, tl, tr, br, bl);
+      return;
+    }
+    auto scratch = &context->scratchPath;
+    scratch->rewind();
+    sk_path_round_rect(scratch, x, y, width, height, tl, tr, br, bl);
+    context->path->addPath(*scratch, *ts);
   }
 
   /// Drawing paths
 
   // Context.fill()
   void sk_context_fill(sk_context* context, SkPath* path, unsigned char rule) {
-    if (path == nullptr) path = context->path;
+    auto fillType = rule == 1 ? SkPathFillType::kEvenOdd : SkPathFillType::kWinding;
+    if (path == nullptr) {
+      context->path->setFillType(fillType);
+      path = sk_context_user_path(context);
+    }
     auto canvas = context->canvas;
-    auto paint = sk_context_fill_paint(context->state);
-    path->setFillType(rule == 1 ? SkPathFillType::kEvenOdd : SkPathFillType::kWinding);
-    auto shadowPaint = sk_context_shadow_blur_paint(context, paint);
+    auto paint = sk_context_fill_paint(context);
+    path->setFillType(fillType);
+    auto shadowPaint = sk_context_shadow_paint(context, true);
     if (shadowPaint != nullptr) {
       canvas->save();
       applyShadowOffsetMatrix(context);
       canvas->drawPath(*path, *shadowPaint);
       canvas->restore();
-      delete shadowPaint;
     }
     canvas->drawPath(*path, *paint);
-    delete paint;
   }
 
   // Context.stroke()
   void sk_context_stroke(sk_context* context, SkPath* path) {
-    if (path == nullptr) path = context->path;
+    if (path == nullptr) path = sk_context_user_path(context);
     auto canvas = context->canvas;
-    auto strokePaint = sk_context_stroke_paint(context->state);
-    auto shadowPaint = sk_context_shadow_blur_paint(context, strokePaint);
+    auto strokePaint = sk_context_stroke_paint(context);
+    auto shadowPaint = sk_context_shadow_paint(context, false);
     if (shadowPaint != nullptr) {
       canvas->save();
       applyShadowOffsetMatrix(context);
       canvas->drawPath(*path, *shadowPaint);
       canvas->restore();
-      delete shadowPaint;
     }
     canvas->drawPath(*path, *strokePaint);
-    delete strokePaint;
   }
 
   // TODO?: Context.drawFocusIfNeeded() (should we support it?)
@@ -918,14 +1211,18 @@ extern "C" {
 
   // Context.clip()
   void sk_context_clip(sk_context* context, SkPath* path, unsigned char rule) {
-    if (path == nullptr) path = context->path;
-    // TODO?: Should we clone?
-    // path = new SkPath(*path);
-    path->setFillType(rule == 1 ? SkPathFillType::kEvenOdd : SkPathFillType::kWinding);
+    auto fillType = rule == 1 ? SkPathFillType::kEvenOdd : SkPathFillType::kWinding;
+    if (path == nullptr) {
+      context->path->setFillType(fillType);
+      path = sk_context_user_path(context);
+    }
+    path->setFillType(fillType);
     context->canvas->clipPath(*path);
   }
 
   // Context.isPointInPath()
+  // The point is in canvas coordinates, which is the space the current
+  // default path is kept in.
   int sk_context_is_point_in_path(sk_context* context, float x, float y, SkPath* path, int rule) {
     if (path == nullptr) path = context->path;
     return sk_path_is_point_in_path(path, x, y, rule);
@@ -933,15 +1230,15 @@ extern "C" {
 
   // Context.isPointInStroke()
   int sk_context_is_point_in_stroke(sk_context* context, float x, float y, SkPath* path) {
-    if (path == nullptr) path = context->path;
-    return sk_path_is_point_in_stroke(path, x, y, context->state->paint->getStrokeWidth());
+    if (path == nullptr) path = sk_context_user_path(context);
+    return sk_path_is_point_in_stroke(path, x, y, context->state->paint.getStrokeWidth());
   }
 
   /// Transformations
 
   // Context.getTransform()
   void sk_context_get_transform(sk_context* context, float* m) {
-    auto matrix = context->state->transform;
+    auto matrix = &context->state->transform;
     m[0] = matrix->getScaleX();
     m[1] = matrix->getSkewY();
     m[2] = matrix->getSkewX();
@@ -950,83 +1247,67 @@ extern "C" {
     m[5] = matrix->getTranslateY();
   }
 
+  // The current path is kept in device space, so none of these need to
+  // touch it.
+
   // Context.rotate()
   void sk_context_rotate(sk_context* context, float angle) {
     auto s = context->state;
-    auto inverse = new SkMatrix();
-    inverse->setRotate(-DEGREES(angle), 0.0f, 0.0f);
-    context->path->transform(*inverse, SkApplyPerspectiveClip::kYes);
-    s->transform->preRotate(DEGREES(angle));
-    context->canvas->setMatrix(*s->transform);
-    delete inverse;
+    s->transform.preRotate(DEGREES(angle));
+    context->canvas->setMatrix(s->transform);
   }
 
   // Context.scale()
   void sk_context_scale(sk_context* context, float x, float y) {
     auto s = context->state;
-    auto inverse = new SkMatrix();
-    inverse->preScale(1.0f / x, 1.0f / y);
-    context->path->transform(*inverse, SkApplyPerspectiveClip::kYes);
-    s->transform->preScale(x, y);
-    context->canvas->setMatrix(*s->transform);
-    delete inverse;
+    s->transform.preScale(x, y);
+    context->canvas->setMatrix(s->transform);
   }
 
   // Context.translate()
   void sk_context_translate(sk_context* context, float x, float y) {
     auto s = context->state;
-    auto inverse = new SkMatrix();
-    inverse->setTranslate(-x, -y);
-    context->path->transform(*inverse, SkApplyPerspectiveClip::kYes);
-    s->transform->preTranslate(x, y);
-    context->canvas->setMatrix(*s->transform);
-    delete inverse;
+    s->transform.preTranslate(x, y);
+    context->canvas->setMatrix(s->transform);
   }
 
   // Context.transform()
   void sk_context_transform(sk_context* context, float a, float b, float c, float d, float e, float f) {
     auto s = context->state;
-    auto ts = new SkMatrix();
-    ts->setAll(a, b, e, c, d, f, 0.0f, 0.0f, 1.0f);
-    context->path->transform(*ts, SkApplyPerspectiveClip::kYes);
-    auto mul = (*ts) * (*s->transform);
-    delete s->transform;
-    s->transform = new SkMatrix(mul);
-    context->canvas->setMatrix(mul);
-    delete ts;
+    s->transform.preConcat(SkMatrix::MakeAll(a, c, e, b, d, f, 0.0f, 0.0f, 1.0f));
+    context->canvas->setMatrix(s->transform);
   }
 
   // Context.setTransform()
   void sk_context_set_transform(sk_context* context, float a, float b, float c, float d, float e, float f) {
     auto s = context->state;
-    auto ts = new SkMatrix();
-    ts->setAll(a, b, e, c, d, f, 0.0f, 0.0f, 1.0f);
-    s->transform = ts;
-    context->canvas->setMatrix(*s->transform);
+    s->transform.setAll(a, c, e, b, d, f, 0.0f, 0.0f, 1.0f);
+    context->canvas->setMatrix(s->transform);
   }
 
   // Context.resetTransform()
   void sk_context_reset_transform(sk_context* context) {
     auto s = context->state;
-    s->transform->reset();
-    context->canvas->setMatrix(*s->transform);
+    s->transform.reset();
+    context->canvas->setMatrix(s->transform);
   }
 
   /// Compositing
 
   // Context.globalAlpha getter
   float sk_context_get_global_alpha(sk_context* context) {
-    return context->state->paint->getAlpha() / 255.0f;
+    return context->state->paint.getAlpha() / 255.0f;
   }
 
   // Context.globalAlpha setter
   void sk_context_set_global_alpha(sk_context* context, float alpha) {
-    context->state->paint->setAlpha(alpha * 255);
+    context->paintsDirty = true;
+    context->state->paint.setAlpha(alpha * 255);
   }
 
   // Context.globalCompositeOperation getter
   int sk_context_get_global_composite_operation(sk_context* context) {
-    switch (context->state->paint->getBlendMode_or(SkBlendMode::kSrcOver)) {
+    switch (context->state->paint.getBlendMode_or(SkBlendMode::kSrcOver)) {
       case SkBlendMode::kSrcOver: return 0;
       case SkBlendMode::kSrcIn: return 1;
       case SkBlendMode::kSrcOut: return 2;
@@ -1059,34 +1340,35 @@ extern "C" {
 
   // Context.globalCompositeOperation setter
   void sk_context_set_global_composite_operation(sk_context* context, unsigned char op) {
+    context->paintsDirty = true;
     switch (op) {
-      case 0: context->state->paint->setBlendMode(SkBlendMode::kSrcOver); break;
-      case 1: context->state->paint->setBlendMode(SkBlendMode::kSrcIn); break;
-      case 2: context->state->paint->setBlendMode(SkBlendMode::kSrcOut); break;
-      case 3: context->state->paint->setBlendMode(SkBlendMode::kSrcATop); break;
-      case 4: context->state->paint->setBlendMode(SkBlendMode::kDstOver); break;
-      case 5: context->state->paint->setBlendMode(SkBlendMode::kDstIn); break;
-      case 6: context->state->paint->setBlendMode(SkBlendMode::kDstOut); break;
-      case 7: context->state->paint->setBlendMode(SkBlendMode::kDstATop); break;
-      case 8: context->state->paint->setBlendMode(SkBlendMode::kXor); break;
-      case 9: context->state->paint->setBlendMode(SkBlendMode::kPlus); break;
-      case 10: context->state->paint->setBlendMode(SkBlendMode::kModulate); break;
-      case 11: context->state->paint->setBlendMode(SkBlendMode::kScreen); break;
-      case 12: context->state->paint->setBlendMode(SkBlendMode::kOverlay); break;
-      case 13: context->state->paint->setBlendMode(SkBlendMode::kDarken); break;
-      case 14: context->state->paint->setBlendMode(SkBlendMode::kLighten); break;
-      case 15: context->state->paint->setBlendMode(SkBlendMode::kColorDodge); break;
-      case 16: context->state->paint->setBlendMode(SkBlendMode::kColorBurn); break;
-      case 17: context->state->paint->setBlendMode(SkBlendMode::kHardLight); break;
-      case 18: context->state->paint->setBlendMode(SkBlendMode::kSoftLight); break;
-      case 19: context->state->paint->setBlendMode(SkBlendMode::kDifference); break;
-      case 20: context->state->paint->setBlendMode(SkBlendMode::kExclusion); break;
-      case 21: context->state->paint->setBlendMode(SkBlendMode::kMultiply); break;
-      case 22: context->state->paint->setBlendMode(SkBlendMode::kHue); break;
-      case 23: context->state->paint->setBlendMode(SkBlendMode::kSaturation); break;
-      case 24: context->state->paint->setBlendMode(SkBlendMode::kColor); break;
-      case 25: context->state->paint->setBlendMode(SkBlendMode::kLuminosity); break;
-      default: context->state->paint->setBlendMode(SkBlendMode::kSrcOver); break;
+      case 0: context->state->paint.setBlendMode(SkBlendMode::kSrcOver); break;
+      case 1: context->state->paint.setBlendMode(SkBlendMode::kSrcIn); break;
+      case 2: context->state->paint.setBlendMode(SkBlendMode::kSrcOut); break;
+      case 3: context->state->paint.setBlendMode(SkBlendMode::kSrcATop); break;
+      case 4: context->state->paint.setBlendMode(SkBlendMode::kDstOver); break;
+      case 5: context->state->paint.setBlendMode(SkBlendMode::kDstIn); break;
+      case 6: context->state->paint.setBlendMode(SkBlendMode::kDstOut); break;
+      case 7: context->state->paint.setBlendMode(SkBlendMode::kDstATop); break;
+      case 8: context->state->paint.setBlendMode(SkBlendMode::kXor); break;
+      case 9: context->state->paint.setBlendMode(SkBlendMode::kPlus); break;
+      case 10: context->state->paint.setBlendMode(SkBlendMode::kModulate); break;
+      case 11: context->state->paint.setBlendMode(SkBlendMode::kScreen); break;
+      case 12: context->state->paint.setBlendMode(SkBlendMode::kOverlay); break;
+      case 13: context->state->paint.setBlendMode(SkBlendMode::kDarken); break;
+      case 14: context->state->paint.setBlendMode(SkBlendMode::kLighten); break;
+      case 15: context->state->paint.setBlendMode(SkBlendMode::kColorDodge); break;
+      case 16: context->state->paint.setBlendMode(SkBlendMode::kColorBurn); break;
+      case 17: context->state->paint.setBlendMode(SkBlendMode::kHardLight); break;
+      case 18: context->state->paint.setBlendMode(SkBlendMode::kSoftLight); break;
+      case 19: context->state->paint.setBlendMode(SkBlendMode::kDifference); break;
+      case 20: context->state->paint.setBlendMode(SkBlendMode::kExclusion); break;
+      case 21: context->state->paint.setBlendMode(SkBlendMode::kMultiply); break;
+      case 22: context->state->paint.setBlendMode(SkBlendMode::kHue); break;
+      case 23: context->state->paint.setBlendMode(SkBlendMode::kSaturation); break;
+      case 24: context->state->paint.setBlendMode(SkBlendMode::kColor); break;
+      case 25: context->state->paint.setBlendMode(SkBlendMode::kLuminosity); break;
+      default: context->state->paint.setBlendMode(SkBlendMode::kSrcOver); break;
     }
   }
 
@@ -1107,7 +1389,7 @@ extern "C" {
     float dh
   ) {
     if (canvas != nullptr) {
-      image = canvas->surface->makeImageSnapshot().release();
+      image = sk_canvas_snapshot(canvas).release();
     }
 
     SkSamplingOptions options;
@@ -1134,7 +1416,7 @@ extern "C" {
     auto srcrect = SkRect::MakeXYWH(sx, sy, sw, sh);
     auto dstrect = SkRect::MakeXYWH(dx, dy, dw, dh);
 
-    auto shadowPaint = sk_context_drop_shadow_paint(context, context->state->paint);
+    auto shadowPaint = sk_context_image_shadow_paint(context);
     if (shadowPaint != nullptr) {
       context->canvas->drawImageRect(
         image,
@@ -1144,7 +1426,6 @@ extern "C" {
         shadowPaint,
         SkCanvas::kFast_SrcRectConstraint
       );
-      delete shadowPaint;
     }
 
     context->canvas->drawImageRect(
@@ -1152,7 +1433,7 @@ extern "C" {
       dstrect,
       srcrect,
       options,
-      context->state->paint,
+      &context->state->paint,
       SkCanvas::kFast_SrcRectConstraint
     );
 
@@ -1161,6 +1442,23 @@ extern "C" {
     }
   }
 
+  // Non-standard Context.drawPicture(), replays a recorded picture scaled
+  // from its bounds to the destination rect
+  void sk_context_draw_picture(sk_context* context, SkPicture* picture, float dx, float dy, float dw, float dh) {
+    auto bounds = picture->cullRect();
+    if (bounds.isEmpty()) return;
+    auto matrix = SkMatrix::RectToRect(bounds, SkRect::MakeXYWH(dx, dy, dw, dh));
+    auto shadowPaint = sk_context_image_shadow_paint(context);
+    if (shadowPaint != nullptr) {
+      context->canvas->drawPicture(picture, &matrix, shadowPaint);
+    }
+    // A paint makes the picture draw through a layer, only use one when
+    // alpha, compositing or filters require it
+    auto paint = &context->state->paint;
+    auto plain = paint->getAlpha() == 255 && paint->isSrcOver() && paint->getImageFilter() == nullptr;
+    context->canvas->drawPicture(picture, &matrix, plain ? nullptr : paint);
+  }
+
   /// Pixel manipulation
 
   // Context.createImageData() implemented in JS
@@ -1215,19 +1513,23 @@ extern "C" {
   /// The canvas state
 
   // Context.save()
+  // The current state is the top of the stack; saving pushes a copy of it.
+  // Heavy members are ref-counted or interned and the derived paints live on
+  // the context, so copying never allocates once the stack has grown to its
+  // deepest nesting.
   void sk_context_save(sk_context* context) {
     context->canvas->save();
-    context->states.push_back(clone_context_state(context->state));
+    context->states.push_back(*context->state);
+    context->state = &context->states.back();
   }
 
   // Context.restore()
   void sk_context_restore(sk_context* context) {
-    if (context->states.size() > 0) {
+    if (context->states.size() > 1) {
       context->canvas->restore();
-      free_context_state(context->state);
-      delete context->state;
-      context->state = context->states.back();
       context->states.pop_back();
+      context->state = &context->states.back();
+      context->paintsDirty = true;
     }
   }
 
@@ -1239,12 +1541,13 @@ extern "C" {
   /// Filters
   
   void sk_context_filter_reset(sk_context* context) {
-    if (context->state->filter.get() != nullptr) context->state->filter->unref();
     context->state->filter = sk_sp((SkImageFilter*) nullptr);
+    context->paintsDirty = true;
   }
 
   void sk_context_filter_blur(sk_context* context, float blur) {
     context->state->filter = SkImageFilters::Blur(blur, blur, SkTileMode::kClamp, context->state->filter);
+    context->paintsDirty = true;
   }
 
   void sk_context_filter_brightness(sk_context* context, float brightness) {
@@ -1255,6 +1558,7 @@ extern "C" {
       0.0, 0.0, 0.0, 1.0, 0.0);
     auto color_filter = SkColorFilters::Matrix(color_matrix);
     context->state->filter = SkImageFilters::ColorFilter(color_filter, context->state->filter);
+    context->paintsDirty = true;
   }
 
   void sk_context_filter_contrast(sk_context* context, float contrast) {
@@ -1265,6 +1569,7 @@ extern "C" {
     }
     auto color_filter = SkColorFilters::TableARGB(table, table, table, table);
     context->state->filter = SkImageFilters::ColorFilter(color_filter, context->state->filter);
+    context->paintsDirty = true;
   }
 
   int sk_context_filter_drop_shadow(sk_context* context, float dx, float dy, float blur, char* style) {
@@ -1280,6 +1585,7 @@ extern "C" {
       }
       float sigma = blur / 2.0f;
       context->state->filter = SkImageFilters::DropShadow(dx, dy, sigma, sigma, SkColorSetARGB(a, r, g, b), context->state->filter);
+      context->paintsDirty = true;
       return 1;
     }
     return 0;
@@ -1294,6 +1600,7 @@ extern "C" {
       0.0, 0.0, 0.0, 1.0, 0.0);
     auto color_filter = SkColorFilters::Matrix(color_matrix);
     context->state->filter = SkImageFilters::ColorFilter(color_filter, context->state->filter);
+    context->paintsDirty = true;
   }
 
   void sk_context_filter_hue_rotate(sk_context* context, float angle) {
@@ -1307,6 +1614,7 @@ extern "C" {
       0.0, 0.0, 0.0, 1.0, 0.0);
     auto color_filter = SkColorFilters::Matrix(color_matrix);
     context->state->filter = SkImageFilters::ColorFilter(color_filter, context->state->filter);
+    context->paintsDirty = true;
   }
 
   void sk_context_filter_invert(sk_context* context, float invert) {
@@ -1318,6 +1626,7 @@ extern "C" {
       0.0, 0.0, 0.0, 1.0, 0.0);
     auto color_filter = SkColorFilters::Matrix(color_matrix);
     context->state->filter = SkImageFilters::ColorFilter(color_filter, context->state->filter);
+    context->paintsDirty = true;
   }
 
   void sk_context_filter_opacity(sk_context* context, float opacity) {
@@ -1328,6 +1637,7 @@ extern "C" {
       0.0, 0.0, 0.0, opacity, 0.0);
     auto color_filter = SkColorFilters::Matrix(color_matrix);
     context->state->filter = SkImageFilters::ColorFilter(color_filter, context->state->filter);
+    context->paintsDirty = true;
   }
 
   void sk_context_filter_saturated(sk_context* context, float saturate) {
@@ -1339,6 +1649,7 @@ extern "C" {
       0.0, 0.0, 0.0, 1.0, 0.0);
     auto color_filter = SkColorFilters::Matrix(color_matrix);
     context->state->filter = SkImageFilters::ColorFilter(color_filter, context->state->filter);
+    context->paintsDirty = true;
   }
 
   void sk_context_filter_sepia(sk_context* context, float sepia) {
@@ -1350,16 +1661,233 @@ extern "C" {
       0.0, 0.0, 0.0, 1.0, 0.0);
     auto color_filter = SkColorFilters::Matrix(color_matrix);
     context->state->filter = SkImageFilters::ColorFilter(color_filter, context->state->filter);
+    context->paintsDirty = true;
+  }
+
+  /// Command buffer
+
+  // Replays a batch of commands recorded by src/commands.ts, so that a frame
+  // built out of many small calls crosses the FFI boundary once. Decoding
+  // stops at the first unknown opcode or truncated command.
+  void sk_context_execute(sk_context* context, const uint8_t* ops, size_t len) {
+    sk_command_reader reader = { ops, ops + len };
+    uint32_t op;
+    float a[8];
+    char* str;
+    int strLen;
+
+    while (command_read_u32(&reader, &op)) {
+      switch ((ContextOp) op) {
+        case kOpClearRect:
+          if (!command_read_f32(&reader, 4, a)) return;
+          sk_context_clear_rect(context, a[0], a[1], a[2], a[3]);
+          break;
+        case kOpFillRect:
+          if (!command_read_f32(&reader, 4, a)) return;
+          sk_context_fill_rect(context, a[0], a[1], a[2], a[3]);
+          break;
+        case kOpStrokeRect:
+          if (!command_read_f32(&reader, 4, a)) return;
+          sk_context_stroke_rect(context, a[0], a[1], a[2], a[3]);
+          break;
+        case kOpFillText:
+        case kOpStrokeText:
+          if (!command_read_f32(&reader, 3, a)) return;
+          if (!command_read_string(&reader, &str, &strLen)) return;
+          sk_context_text(context, str, strLen, a[0], a[1], a[2], op == kOpFillText ? 1 : 0, nullptr);
+          break;
+        case kOpSetLineWidth:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_set_line_width(context, a[0]);
+          break;
+        case kOpSetLineCap:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_set_line_cap(context, (int) a[0]);
+          break;
+        case kOpSetLineJoin:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_set_line_join(context, (int) a[0]);
+          break;
+        case kOpSetMiterLimit:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_set_miter_limit(context, a[0]);
+          break;
+        case kOpSetLineDash: {
+          uint32_t count;
+          if (!command_read_u32(&reader, &count)) return;
+          if (count > INT_MAX / 4 || (size_t)(reader.end - reader.cur) < 4 * (size_t) count) return;
+          // Read in place when the caller's buffer is aligned, as it is for
+          // the typed arrays of CommandBuffer
+          if ((uintptr_t) reader.cur % alignof(float) == 0) {
+            sk_context_set_line_dash(context, (float*) reader.cur, count);
+          } else {
+            std::vector<float> dash(count);
+            memcpy(dash.data(), reader.cur, 4 * (size_t) count);
+            sk_context_set_line_dash(context, dash.data(), count);
+          }
+          reader.cur += 4 * count;
+          break;
+        }
+        case kOpSetLineDashOffset:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_set_line_dash_offset(context, a[0]);
+          break;
+        case kOpSetFont:
+          if (!command_read_f32(&reader, 5, a)) return;
+          if (!command_read_string(&reader, &str, &strLen)) return;
+          sk_context_set_font(context, a[0], str, (unsigned int) a[1], (int) a[2], (int) a[3], (int) a[4]);
+          break;
+        case kOpSetTextAlign:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_set_text_align(context, (int) a[0]);
+          break;
+        case kOpSetTextBaseline:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_set_text_baseline(context, (int) a[0]);
+          break;
+        case kOpSetTextDirection:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_set_text_direction(context, (int) a[0]);
+          break;
+        case kOpSetLetterSpacing:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_set_letter_spacing(context, a[0]);
+          break;
+        case kOpSetWordSpacing:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_set_word_spacing(context, a[0]);
+          break;
+        case kOpSetFillStyle:
+          if (!command_read_string(&reader, &str, &strLen)) return;
+          sk_context_set_fill_style(context, str);
+          break;
+        case kOpSetStrokeStyle:
+          if (!command_read_string(&reader, &str, &strLen)) return;
+          sk_context_set_stroke_style(context, str);
+          break;
+        case kOpSetShadowBlur:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_set_shadow_blur(context, a[0]);
+          break;
+        case kOpSetShadowColor:
+          if (!command_read_string(&reader, &str, &strLen)) return;
+          sk_context_set_shadow_color(context, str);
+          break;
+        case kOpSetShadowOffsetX:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_set_shadow_offset_x(context, a[0]);
+          break;
+        case kOpSetShadowOffsetY:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_set_shadow_offset_y(context, a[0]);
+          break;
+        case kOpBeginPath:
+          sk_context_begin_path(context);
+          break;
+        case kOpClosePath:
+          sk_context_close_path(context);
+          break;
+        case kOpMoveTo:
+          if (!command_read_f32(&reader, 2, a)) return;
+          sk_context_move_to(context, a[0], a[1]);
+          break;
+        case kOpLineTo:
+          if (!command_read_f32(&reader, 2, a)) return;
+          sk_context_line_to(context, a[0], a[1]);
+          break;
+        case kOpBezierCurveTo:
+          if (!command_read_f32(&reader, 6, a)) return;
+          sk_context_bezier_curve_to(context, a[0], a[1], a[2], a[3], a[4], a[5]);
+          break;
+        case kOpQuadraticCurveTo:
+          if (!command_read_f32(&reader, 4, a)) return;
+          sk_context_quadratic_curve_to(context, a[0], a[1], a[2], a[3]);
+          break;
+        case kOpArc:
+          if (!command_read_f32(&reader, 6, a)) return;
+          sk_context_arc(context, a[0], a[1], a[2], a[3], a[4], a[5] != 0);
+          break;
+        case kOpArcTo:
+          if (!command_read_f32(&reader, 5, a)) return;
+          sk_context_arc_to(context, a[0], a[1], a[2], a[3], a[4]);
+          break;
+        case kOpEllipse:
+          if (!command_read_f32(&reader, 8, a)) return;
+          sk_context_ellipse(context, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7] != 0);
+          break;
+        case kOpRect:
+          if (!command_read_f32(&reader, 4, a)) return;
+          sk_context_rect(context, a[0], a[1], a[2], a[3]);
+          break;
+        case kOpRoundRect:
+          if (!command_read_f32(&reader, 8, a)) return;
+          sk_context_round_rect(context, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+          break;
+        case kOpFill:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_fill(context, nullptr, (unsigned char) a[0]);
+          break;
+        case kOpStroke:
+          sk_context_stroke(context, nullptr);
+          break;
+        case kOpClip:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_clip(context, nullptr, (unsigned char) a[0]);
+          break;
+        case kOpRotate:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_rotate(context, a[0]);
+          break;
+        case kOpScale:
+          if (!command_read_f32(&reader, 2, a)) return;
+          sk_context_scale(context, a[0], a[1]);
+          break;
+        case kOpTranslate:
+          if (!command_read_f32(&reader, 2, a)) return;
+          sk_context_translate(context, a[0], a[1]);
+          break;
+        case kOpTransform:
+          if (!command_read_f32(&reader, 6, a)) return;
+          sk_context_transform(context, a[0], a[1], a[2], a[3], a[4], a[5]);
+          break;
+        case kOpSetTransform:
+          if (!command_read_f32(&reader, 6, a)) return;
+          sk_context_set_transform(context, a[0], a[1], a[2], a[3], a[4], a[5]);
+          break;
+        case kOpResetTransform:
+          sk_context_reset_transform(context);
+          break;
+        case kOpSetGlobalAlpha:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_set_global_alpha(context, a[0]);
+          break;
+        case kOpSetGlobalCompositeOperation:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_set_global_composite_operation(context, (unsigned char) a[0]);
+          break;
+        case kOpSetImageSmoothingEnabled:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_set_image_smoothing_enabled(context, (int) a[0]);
+          break;
+        case kOpSetImageSmoothingQuality:
+          if (!command_read_f32(&reader, 1, a)) return;
+          sk_context_set_image_smoothing_quality(context, (int) a[0]);
+          break;
+        case kOpSave:
+          sk_context_save(context);
+          break;
+        case kOpRestore:
+          sk_context_restore(context);
+          break;
+        default:
+          return;
+      }
+    }
   }
 
   void sk_context_destroy(sk_context* context) {
     delete context->path;
-    free_context_state(context->state);
-    delete context->state;
-    for (auto state : context->states) {
-      free_context_state(state);
-      delete state;
-    }
+    delete context->textBuilder;
     delete context;
   }
 }
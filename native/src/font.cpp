@@ -1,77 +1,423 @@
 #include "include/font.hpp"
+#include "include/textcache.hpp"
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <system_error>
 
 int systemFontsLoaded = -1;
 sk_sp<SkFontMgr> fontMgr = nullptr;
-sk_sp<skia::textlayout::FontCollection> fontCollection = nullptr;
-sk_sp<skia::textlayout::TypefaceFontProvider> assets = nullptr;
+sk_sp<FontIndexProvider> assets = nullptr;
+std::shared_mutex fontLock;
+// Bumped whenever fonts are registered, see sk_font_collection
+static std::atomic<uint64_t> fontGeneration { 0 };
+
+const sk_sp<skia::textlayout::FontCollection>& sk_font_collection() {
+  thread_local sk_sp<skia::textlayout::FontCollection> collection = nullptr;
+  thread_local uint64_t generation = 0;
+  auto current = fontGeneration.load();
+  if (collection == nullptr || generation != current) {
+    collection = sk_sp(new skia::textlayout::FontCollection());
+    collection->setDefaultFontManager(fontMgr);
+    collection->setAssetFontManager(assets);
+    generation = current;
+  }
+  return collection;
+}
+
+// Called with fontLock held exclusively after registering fonts
+static void fonts_changed() {
+  fontGeneration++;
+  // New fonts may change fallback for already shaped text
+  sk_text_cache_clear();
+}
+
+static int register_typeface(sk_sp<SkTypeface> tf, const char* alias) {
+  auto result = assets->registerTypeface(tf);
+  if (alias != nullptr) assets->registerTypeface(tf, SkString(alias));
+  return (int) result;
+}
+
+static int register_dir(const char* path) {
+  // Recursively register all fonts in a directory
+  int count = 0;
+  for (std::filesystem::recursive_directory_iterator i(path), end; i != end; ++i) {
+    if (!std::filesystem::is_directory(i->path())) {
+      auto ext = i->path().extension();
+      if (ext == ".ttf" || ext == ".otf" || ext == ".ttc" || ext == ".pfb" || ext == ".woff" || ext == ".woff2") {
+        register_typeface(fontMgr->makeFromFile(i->path().string().c_str()), nullptr);
+        count++;
+      }
+    }
+  }
+  return count;
+}
+
+/// Font index
+
+#define FONT_INDEX_MAGIC "skia_canvas font index 1"
+
+typedef struct font_index_record {
+  std::string family;
+  std::string path;
+  int index;
+} font_index_record;
+
+static uint16_t read_u16(const uint8_t* p) {
+  return (p[0] << 8) | p[1];
+}
+
+static uint32_t read_u32(const uint8_t* p) {
+  return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static bool read_at(std::ifstream& file, uint32_t offset, void* out, size_t size) {
+  file.seekg(offset);
+  return (bool) file.read((char*) out, size);
+}
+
+// Decodes a name table string to UTF-8. Windows and Unicode platform names
+// are UTF-16BE, Macintosh Roman names are treated as Latin-1.
+static std::string decode_name(const uint8_t* data, size_t length, bool utf16) {
+  std::string out;
+  auto append = [&](uint32_t c) {
+    if (c < 0x80) {
+      out += (char) c;
+    } else if (c < 0x800) {
+      out += (char) (0xc0 | (c >> 6));
+      out += (char) (0x80 | (c & 0x3f));
+    } else {
+      out += (char) (0xe0 | (c >> 12));
+      out += (char) (0x80 | ((c >> 6) & 0x3f));
+      out += (char) (0x80 | (c & 0x3f));
+    }
+  };
+  if (utf16) {
+    // Family names outside the BMP don't occur in practice, surrogates are
+    // dropped
+    for (size_t i = 0; i + 1 < length; i += 2) {
+      auto c = read_u16(data + i);
+      if (c < 0xd800 || c > 0xdfff) append(c);
+    }
+  } else {
+    for (size_t i = 0; i < length; i++) append(data[i]);
+  }
+  return out;
+}
+
+// Reads the family names (name IDs 1 and 16) of every face in a TrueType or
+// OpenType file or collection, touching only the headers and name tables.
+static bool read_sfnt_families(const std::string& path, std::vector<font_index_record>* out) {
+  std::ifstream file(path, std::ios::binary);
+  uint8_t header[12];
+  if (!read_at(file, 0, header, 12)) return false;
+
+  // Anything else (WOFF, WOFF2, Type 1) has no plain table directory
+  auto version = read_u32(header);
+  bool collection = memcmp(header, "ttcf", 4) == 0;
+  if (!collection && version != 0x00010000 && memcmp(header, "OTTO", 4) != 0 && memcmp(header, "true", 4) != 0) {
+    return false;
+  }
+
+  std::vector<uint32_t> faces;
+  if (collection) {
+    auto numFonts = read_u32(header + 8);
+    if (numFonts == 0 || numFonts > 1024) return false;
+    std::vector<uint8_t> offsets(numFonts * 4);
+    if (!read_at(file, 12, offsets.data(), offsets.size())) return false;
+    for (uint32_t i = 0; i < numFonts; i++) faces.push_back(read_u32(&offsets[i * 4]));
+  } else {
+    faces.push_back(0);
+  }
+
+  for (size_t face = 0; face < faces.size(); face++) {
+    uint8_t dir[12];
+    if (!read_at(file, faces[face], dir, 12)) return false;
+    auto numTables = read_u16(dir + 4);
+    std::vector<uint8_t> tables(numTables * 16);
+    if (!read_at(file, faces[face] + 12, tables.data(), tables.size())) return false;
+
+    uint32_t nameOffset = 0, nameLength = 0;
+    for (int i = 0; i < numTables; i++) {
+      if (memcmp(&tables[i * 16], "name", 4) == 0) {
+        nameOffset = read_u32(&tables[i * 16 + 8]);
+        nameLength = read_u32(&tables[i * 16 + 12]);
+        break;
+      }
+    }
+    if (nameLength < 6 || nameLength > 1024 * 1024) continue;
+    std::vector<uint8_t> name(nameLength);
+    if (!read_at(file, nameOffset, name.data(), nameLength)) return false;
+
+    auto count = read_u16(&name[2]);
+    auto storage = read_u16(&name[4]);
+    // Best candidate for name IDs 1 and 16: Windows English, any Windows
+    // or Unicode name, then Macintosh Roman
+    std::string names[2];
+    int ranks[2] = { 0, 0 };
+    for (int i = 0; i < count && 6 + (i + 1) * 12 <= (int) nameLength; i++) {
+      auto record = &name[6 + i * 12];
+      auto platform = read_u16(record);
+      auto encoding = read_u16(record + 2);
+      auto language = read_u16(record + 4);
+      auto nameId = read_u16(record + 6);
+      auto length = read_u16(record + 8);
+      auto offset = storage + read_u16(record + 10);
+      if ((nameId != 1 && nameId != 16) || offset + length > nameLength) continue;
+      int rank = 0;
+      if (platform == 3 && language == 0x409) rank = 3;
+      else if (platform == 3 || platform == 0) rank = 2;
+      else if (platform == 1 && encoding == 0) rank = 1;
+      auto slot = nameId == 1 ? 0 : 1;
+      if (rank > ranks[slot]) {
+        ranks[slot] = rank;
+        names[slot] = decode_name(&name[offset], length, platform != 1);
+      }
+    }
+    for (int slot = 0; slot < 2; slot++) {
+      if (names[slot].empty() || (slot == 1 && names[1] == names[0])) continue;
+      out->push_back({ names[slot], path, (int) face });
+    }
+  }
+  return true;
+}
+
+static bool is_font_file(const std::filesystem::path& path) {
+  auto ext = path.extension();
+  return ext == ".ttf" || ext == ".otf" || ext == ".ttc" || ext == ".pfb" || ext == ".woff" || ext == ".woff2";
+}
+
+static long long dir_mtime(const std::filesystem::path& path) {
+  std::error_code ec;
+  auto time = std::filesystem::last_write_time(path, ec);
+  return ec ? -1 : (long long) time.time_since_epoch().count();
+}
+
+// Parses the whole of `str`, this runs under the font lock and must not throw
+template <typename T>
+static bool parse_int(const std::string& str, T* out) {
+  auto end = str.data() + str.size();
+  auto result = std::from_chars(str.data(), end, *out);
+  return result.ec == std::errc() && result.ptr == end;
+}
+
+// The cache holds the indexed root, the mtime of every directory under it
+// and the records. Adding or removing fonts changes the mtime of their
+// directory, which invalidates the cache. A malformed cache is a miss.
+static bool read_font_index_cache(const char* cachePath, const char* root, std::vector<font_index_record>* records) {
+  std::ifstream file(cachePath);
+  std::string line;
+  if (!std::getline(file, line) || line != FONT_INDEX_MAGIC) return false;
+  if (!std::getline(file, line) || line != root) return false;
+  while (std::getline(file, line)) {
+    auto first = line.find('\t');
+    auto second = line.find('\t', first + 1);
+    if (first == std::string::npos || second == std::string::npos) return false;
+    if (line[0] == 'D') {
+      long long mtime;
+      if (!parse_int(line.substr(first + 1, second - first - 1), &mtime)) return false;
+      if (dir_mtime(line.substr(second + 1)) != mtime) return false;
+    } else if (line[0] == 'F') {
+      auto third = line.find('\t', second + 1);
+      int index;
+      if (third == std::string::npos || !parse_int(line.substr(first + 1, second - first - 1), &index)) return false;
+      records->push_back({
+        line.substr(second + 1, third - second - 1),
+        line.substr(third + 1),
+        index
+      });
+    }
+  }
+  return true;
+}
+
+static void write_font_index_cache(const char* cachePath, const char* root, const std::vector<std::string>& dirs, const std::vector<font_index_record>& records) {
+  std::error_code ec;
+  std::filesystem::create_directories(std::filesystem::path(cachePath).parent_path(), ec);
+  std::ofstream file(cachePath, std::ios::trunc);
+  if (!file) return;
+  file << FONT_INDEX_MAGIC << "\n" << root << "\n";
+  for (auto& dir : dirs) {
+    file << "D\t" << dir_mtime(dir) << "\t" << dir << "\n";
+  }
+  for (auto& record : records) {
+    file << "F\t" << record.index << "\t" << record.family << "\t" << record.path << "\n";
+  }
+}
+
+int FontIndexProvider::indexDir(const char* root, const char* cachePath) {
+  std::vector<font_index_record> records;
+  if (cachePath == nullptr || !read_font_index_cache(cachePath, root, &records)) {
+    records.clear();
+    std::vector<std::string> dirs = { root };
+    std::error_code ec;
+    for (std::filesystem::recursive_directory_iterator i(root, ec), end; i != end; i.increment(ec)) {
+      if (ec) break;
+      if (i->is_directory(ec)) {
+        dirs.push_back(i->path().string());
+      } else if (is_font_file(i->path())) {
+        auto path = i->path().string();
+        if (!read_sfnt_families(path, &records)) {
+          // Compressed or Type 1 fonts: fall back to loading the typeface
+          auto tf = fontMgr->makeFromFile(path.c_str());
+          if (tf == nullptr) continue;
+          SkString family;
+          tf->getFamilyName(&family);
+          records.push_back({ family.c_str(), path, 0 });
+        }
+      }
+    }
+    if (cachePath != nullptr) write_font_index_cache(cachePath, root, dirs, records);
+  }
+
+  int count = 0;
+  for (auto& record : records) {
+    auto& faces = pending[record.family];
+    faces.push_back({ record.path, record.index });
+    count++;
+  }
+  return count;
+}
+
+void FontIndexProvider::loadFamily(const char* familyName) const {
+  if (familyName == nullptr || pending.empty()) return;
+  auto it = pending.find(familyName);
+  if (it == pending.end()) return;
+  auto faces = std::move(it->second);
+  pending.erase(it);
+  auto self = const_cast<FontIndexProvider*>(this);
+  for (auto& face : faces) {
+    auto tf = fontMgr->makeFromFile(face.path.c_str(), face.index);
+    if (tf != nullptr) self->registerTypeface(tf, SkString(familyName));
+  }
+}
+
+SkFontStyleSet* FontIndexProvider::onMatchFamily(const char familyName[]) const {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  loadFamily(familyName);
+  return TypefaceFontProvider::onMatchFamily(familyName);
+}
+
+SkTypeface* FontIndexProvider::onMatchFamilyStyle(const char familyName[], const SkFontStyle& style) const {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  loadFamily(familyName);
+  return TypefaceFontProvider::onMatchFamilyStyle(familyName, style);
+}
+
+int FontIndexProvider::onCountFamilies() const {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  return TypefaceFontProvider::onCountFamilies();
+}
+
+void FontIndexProvider::onGetFamilyName(int index, SkString* familyName) const {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  TypefaceFontProvider::onGetFamilyName(index, familyName);
+}
+
+SkFontStyleSet* FontIndexProvider::onCreateStyleSet(int index) const {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  return TypefaceFontProvider::onCreateStyleSet(index);
+}
+
+sk_sp<SkTypeface> FontIndexProvider::onLegacyMakeTypeface(const char familyName[], SkFontStyle style) const {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  return TypefaceFontProvider::onLegacyMakeTypeface(familyName, style);
+}
 
 extern "C" {
+  // Called by every worker loading the module, only the first call sets up
   void setup_font_collection() {
-    if (fontCollection == nullptr) {
+    static std::once_flag once;
+    std::call_once(once, [] {
       fontMgr = SkFontMgr::RefDefault();
-      fontCollection = sk_sp(new skia::textlayout::FontCollection());
-      assets = sk_sp(new skia::textlayout::TypefaceFontProvider());
-      fontCollection->setDefaultFontManager(fontMgr);
-      fontCollection->setAssetFontManager(assets);
-    }
+      assets = sk_sp(new FontIndexProvider());
+    });
   }
 
   int fonts_register_path(const char* path, char* alias) {
     auto tf = fontMgr->makeFromFile(path);
-    auto result = assets->registerTypeface(tf);
-    if (alias != nullptr) assets->registerTypeface(tf, SkString(alias));
-    return (int) result;
+    std::unique_lock<std::shared_mutex> lock(fontLock);
+    auto result = register_typeface(tf, alias);
+    fonts_changed();
+    return result;
   }
 
   int fonts_register_memory(const void* data, size_t length, char* alias) {
     auto tf = fontMgr->makeFromData(sk_sp<SkData>(SkData::MakeWithoutCopy(data, length)));
-    auto result = assets->registerTypeface(tf);
-    if (alias != nullptr) assets->registerTypeface(tf, SkString(alias));
-    return (int) result;
+    std::unique_lock<std::shared_mutex> lock(fontLock);
+    auto result = register_typeface(tf, alias);
+    fonts_changed();
+    return result;
   }
 
   int fonts_register_dir(char* path) {
-    // Recursively register all fonts in a directory
-    int count = 0;
-    for (std::filesystem::recursive_directory_iterator i(path), end; i != end; ++i) {
-      if (!std::filesystem::is_directory(i->path())) {
-        auto ext = i->path().extension();
-        if (ext == ".ttf" || ext == ".otf" || ext == ".ttc" || ext == ".pfb" || ext == ".woff" || ext == ".woff2") {
-          fonts_register_path((const char*) i->path().c_str(), nullptr);
-          count++;
-        }
-      }
-    }
+    std::unique_lock<std::shared_mutex> lock(fontLock);
+    auto count = register_dir(path);
+    fonts_changed();
     return count;
   }
 
   int load_system_fonts() {
+    std::unique_lock<std::shared_mutex> lock(fontLock);
+    if (systemFontsLoaded == -1) {
+      systemFontsLoaded = 0;
+      #if defined(__APPLE__)
+        systemFontsLoaded = register_dir("/System/Library/Fonts");
+      #endif
+      #if defined(__linux__)
+        systemFontsLoaded = register_dir("/usr/share/fonts");
+      #endif
+      #if defined(_WIN32)
+        systemFontsLoaded = register_dir("C:\\Windows\\Fonts");
+      #endif
+      fonts_changed();
+    }
+    return systemFontsLoaded;
+  }
+
+  // Like fonts_register_dir, but only indexes the fonts, see FontIndexProvider
+  int fonts_index_dir(char* path) {
+    std::unique_lock<std::shared_mutex> lock(fontLock);
+    auto count = assets->indexDir(path, nullptr);
+    fonts_changed();
+    return count;
+  }
+
+  // Like load_system_fonts, but only indexes the fonts, see FontIndexProvider
+  int index_system_fonts(const char* cachePath) {
+    std::unique_lock<std::shared_mutex> lock(fontLock);
     if (systemFontsLoaded == -1) {
       systemFontsLoaded = 0;
       #if defined(__APPLE__)
-        systemFontsLoaded = fonts_register_dir("/System/Library/Fonts");
+        systemFontsLoaded = assets->indexDir("/System/Library/Fonts", cachePath);
       #endif
       #if defined(__linux__)
-        systemFontsLoaded = fonts_register_dir("/usr/share/fonts");
+        systemFontsLoaded = assets->indexDir("/usr/share/fonts", cachePath);
       #endif
       #if defined(_WIN32)
-        systemFontsLoaded = fonts_register_dir("C:\\Windows\\Fonts");
+        systemFontsLoaded = assets->indexDir("C:\\Windows\\Fonts", cachePath);
       #endif
+      fonts_changed();
     }
     return systemFontsLoaded;
   }
 
   void fonts_set_alias(char* alias, char* family) {
+    std::unique_lock<std::shared_mutex> lock(fontLock);
     auto style = SkFontStyle();
     auto typeface = assets->matchFamilyStyle(family, style);
     assets->registerTypeface(sk_sp(typeface), SkString(alias));
+    fonts_changed();
   }
 
   int fonts_count() {
+    std::shared_lock<std::shared_mutex> lock(fontLock);
     return assets->countFamilies();
   }
 
   char* fonts_family(int index) {
+    std::shared_lock<std::shared_mutex> lock(fontLock);
     auto family = new SkString();
     assets->getFamilyName(index, family);
     return (char*) family->c_str();
@@ -0,0 +1,64 @@
+#include "include/mapping.hpp"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+extern "C" {
+  // Maps the first size bytes of a file into memory, shared with every
+  // process mapping the same file. With create, the file is created or
+  // grown to size first; otherwise it must already be large enough. Shared
+  // memory works the same through its path, e.g. /dev/shm/name on Linux.
+  void* sk_file_map(const char* path, uint64_t size, int create) {
+#if defined(_WIN32)
+    auto file = CreateFileA(
+      path,
+      GENERIC_READ | GENERIC_WRITE,
+      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+      nullptr,
+      create ? OPEN_ALWAYS : OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL,
+      nullptr
+    );
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+    LARGE_INTEGER fileSize;
+    if (!create && (!GetFileSizeEx(file, &fileSize) || (uint64_t) fileSize.QuadPart < size)) {
+      CloseHandle(file);
+      return nullptr;
+    }
+    // Grows the file to size if needed
+    auto mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, size >> 32, size & 0xffffffff, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr) return nullptr;
+    auto pixels = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    // The view keeps the mapping alive
+    CloseHandle(mapping);
+    return pixels;
+#else
+    int fd = open(path, create ? O_RDWR | O_CREAT : O_RDWR, 0644);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || ((uint64_t) st.st_size < size && (!create || ftruncate(fd, size) != 0))) {
+      close(fd);
+      return nullptr;
+    }
+    auto pixels = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // The mapping stays valid without the descriptor
+    close(fd);
+    return pixels == MAP_FAILED ? nullptr : pixels;
+#endif
+  }
+
+  void sk_file_unmap(void* pixels, uint64_t size) {
+#if defined(_WIN32)
+    UnmapViewOfFile(pixels);
+#else
+    munmap(pixels, size);
+#endif
+  }
+}
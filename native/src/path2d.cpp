@@ -5,6 +5,58 @@
 #include <math.h>
 #endif
 
+// Skia can't draw a full turn with a single arcTo, so it is split in two.
+static void sk_path_arc_segments(SkPath* path, const SkRect& oval, float startDeg, float sweepDeg) {
+  if (ALMOST_EQUAL(fabs(sweepDeg), 360.0f)) {
+    float halfSweep = sweepDeg / 2.0f;
+    path->arcTo(oval, startDeg, halfSweep, false);
+    path->arcTo(oval, startDeg + halfSweep, halfSweep, false);
+  } else {
+    path->arcTo(oval, startDeg, sweepDeg, false);
+  }
+}
+
+// Appends an elliptical arc to path, mapped through matrix. Rotated (or
+// transformed) arcs are built in a scratch path and appended in one go, so
+// each arc costs the same regardless of how large path already is.
+void sk_path_add_ellipse(SkPath* path, const SkMatrix& matrix, float x, float y, float radiusX, float radiusY, float rotation, float startAngle, float endAngle, bool clockwise) {
+  float tau = 2 * M_PI;
+  float newStartAngle = fmod(startAngle, tau);
+  if (newStartAngle < 0) {
+    newStartAngle += tau;
+  }
+  float delta = newStartAngle - startAngle;
+  startAngle = newStartAngle;
+  endAngle = endAngle + delta;
+
+  if (!clockwise && (endAngle - startAngle) >= tau) {
+    endAngle = startAngle + tau;
+  } else if (clockwise && (startAngle - endAngle) >= tau) {
+    endAngle = startAngle - tau;
+  } else if (!clockwise && startAngle > endAngle) {
+    endAngle = startAngle + (tau - fmod(startAngle - endAngle, tau));
+  } else if (clockwise && startAngle < endAngle) {
+    endAngle = startAngle - (tau - fmod(endAngle - startAngle, tau));
+  }
+
+  SkRect oval = SkRect::MakeLTRB(x - radiusX, y - radiusY, x + radiusX, y + radiusY);
+  float sweepDeg = DEGREES(endAngle - startAngle);
+  float startDeg = DEGREES(startAngle);
+
+  SkMatrix ts = matrix;
+  if (rotation != 0) ts.preRotate(DEGREES(rotation), x, y);
+
+  if (ts.isIdentity()) {
+    sk_path_arc_segments(path, oval, startDeg, sweepDeg);
+    return;
+  }
+
+  thread_local SkPath scratch;
+  scratch.rewind();
+  sk_path_arc_segments(&scratch, oval, startDeg, sweepDeg);
+  path->addPath(scratch, ts, SkPath::kExtend_AddPathMode);
+}
+
 extern "C" {
   SkPath* sk_path_create() {
     return new SkPath();
@@ -50,59 +102,7 @@ extern "C" {
   }
 
   void sk_path_ellipse(SkPath* path, float x, float y, float radiusX, float radiusY, float rotation, float startAngle, float endAngle, bool clockwise) {
-    float tau = 2 * M_PI;
-    float newStartAngle = fmod(startAngle, tau);
-    if (newStartAngle < 0) {
-      newStartAngle += tau;
-    }
-    float delta = newStartAngle - startAngle;
-    startAngle = newStartAngle;
-    endAngle = endAngle + delta;
-
-    if (!clockwise && (endAngle - startAngle) >= tau) {
-      endAngle = startAngle + tau;
-    } else if (clockwise && (startAngle - endAngle) >= tau) {
-      endAngle = startAngle - tau;
-    } else if (!clockwise && startAngle > endAngle) {
-      endAngle = startAngle + (tau - fmod(startAngle - endAngle, tau));
-    } else if (clockwise && startAngle < endAngle) {
-      endAngle = startAngle - (tau - fmod(endAngle - startAngle, tau));
-    }
-
-    float left = x - radiusX;
-    float top = y - radiusY;
-    float right = x + radiusX;
-    float bottom = y + radiusY;
-
-    SkMatrix* rotated = new SkMatrix();
-    rotated->preTranslate(x, y);
-    rotated->preRotate(DEGREES(rotation));
-    rotated->preTranslate(-x, -y);
-    SkMatrix* unrotated = new SkMatrix();
-    rotated->invert(unrotated); // todo assert
-
-    path->transform(*unrotated, SkApplyPerspectiveClip::kYes);
-
-    float sweepDeg = DEGREES(endAngle - startAngle);
-    float startDeg = DEGREES(startAngle);
-
-    if (ALMOST_EQUAL(fabs(sweepDeg), 360.0f)) {
-      float halfSweep = sweepDeg / 2.0f;
-      path->arcTo(SkRect::MakeLTRB(left, top, right, bottom), startDeg, halfSweep, false);
-      path->arcTo(
-        SkRect::MakeLTRB(x - radiusX, y - radiusY, x + radiusX, y + radiusY),
-        startDeg + halfSweep,
-        halfSweep,
-        false
-      );
-    } else {
-      path->arcTo(SkRect::MakeLTRB(left, top, right, bottom), startDeg, sweepDeg, false);
-    }
-
-    path->transform(*rotated, SkApplyPerspectiveClip::kYes);
-
-    delete rotated;
-    delete unrotated;
+    sk_path_add_ellipse(path, SkMatrix::I(), x, y, radiusX, radiusY, rotation, startAngle, endAngle, clockwise);
   }
 
   void sk_path_arc(SkPath* path, float x, float y, float radius, float startAngle, float endAngle, bool clockwise) {
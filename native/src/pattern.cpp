@@ -45,8 +45,6 @@ extern "C" {
   }
 
   sk_sp<SkShader> sk_pattern_to_shader(sk_pattern* pattern) {
-    auto shader = pattern->bitmap->makeShader(pattern->tmx, pattern->tmy, SkSamplingOptions({1.0f / 3.0f, 1.0f / 3.0f}), &pattern->ts);
-    shader->ref();
-    return shader;
+    return pattern->bitmap->makeShader(pattern->tmx, pattern->tmy, SkSamplingOptions({1.0f / 3.0f, 1.0f / 3.0f}), &pattern->ts);
   }
 }
@@ -39,13 +39,8 @@ extern "C" {
     float w,
     float h
   ) {
-    sk_context* ctx = new sk_context();
     auto rect = SkRect::MakeXYWH(x, y, w, h);
-    ctx->canvas = doc->pdf->beginPage(width, height, &rect);
-    ctx->path = new SkPath();
-    ctx->state = create_default_state();
-    ctx->states = std::vector<sk_context_state*>();
-    return ctx;
+    return create_context(doc->pdf->beginPage(width, height, &rect));
   }
 
   void sk_pdf_end_page(sk_pdf_document* doc) {
@@ -0,0 +1,237 @@
+#include "include/png.hpp"
+#include <atomic>
+
+static std::atomic<int> pngThreads { 0 };
+
+#ifdef CANVAS_PARALLEL_PNG
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+// Uncompressed bytes per strip. Each strip starts with an empty deflate
+// window, so much smaller strips compress noticeably worse.
+#define PNG_STRIP_BYTES (1024 * 1024)
+// Bit of the first filter (None) in SkPngEncoder::FilterFlag, the other
+// filters follow in order
+#define PNG_FILTER_NONE_FLAG 0x08
+
+typedef struct png_strip {
+  std::vector<uint8_t> deflated;
+  uLong adler;
+  size_t size;
+  bool done;
+} png_strip;
+
+static void put_u32(uint8_t* out, uint32_t value) {
+  out[0] = value >> 24;
+  out[1] = value >> 16;
+  out[2] = value >> 8;
+  out[3] = value;
+}
+
+static bool write_chunk(SkWStream* stream, const char* type, const uint8_t* data, size_t size) {
+  uint8_t header[8];
+  put_u32(header, size);
+  memcpy(header + 4, type, 4);
+  // crc32 restarts when given a null buffer, as for IEND
+  auto checksum = crc32(0, header + 4, 4);
+  if (size > 0) checksum = crc32(checksum, data, size);
+  uint8_t crc[4];
+  put_u32(crc, checksum);
+  return stream->write(header, 8) && (size == 0 || stream->write(data, size)) && stream->write(crc, 4);
+}
+
+static uint8_t paeth(int a, int b, int c) {
+  int p = a + b - c;
+  int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  if (pa <= pb && pa <= pc) return a;
+  return pb <= pc ? b : c;
+}
+
+// Converts rows [top, top + rows) to unpremultiplied RGBA, or RGB with 3
+// channels, and filters them, choosing per row among the allowed filters
+// the one with the smallest sum of absolute differences like libpng does.
+static void filter_strip(const SkPixmap& pixmap, int top, int rows, int channels, int filters, std::vector<uint8_t>* out) {
+  size_t rowBytes = pixmap.width() * channels;
+  // The row above the strip is needed by the Up, Average and Paeth filters
+  int first = std::max(top - 1, 0);
+  std::vector<uint8_t> raw((rows + 1) * rowBytes, 0);
+  auto dst = raw.data() + (top > 0 ? 0 : rowBytes);
+  auto info = SkImageInfo::Make(pixmap.width(), top + rows - first, kRGBA_8888_SkColorType, kUnpremul_SkAlphaType);
+  if (channels == 4) {
+    pixmap.readPixels(info, dst, rowBytes, 0, first);
+  } else {
+    // Skia has no packed RGB format to convert to
+    std::vector<uint8_t> rgba(info.computeMinByteSize());
+    pixmap.readPixels(info, rgba.data(), info.minRowBytes(), 0, first);
+    for (size_t i = 0, n = (size_t) info.width() * info.height(); i < n; i++) {
+      memcpy(dst + i * 3, &rgba[i * 4], 3);
+    }
+  }
+
+  std::vector<uint8_t> candidates(5 * rowBytes);
+  out->resize(rows * (rowBytes + 1));
+  for (int y = 0; y < rows; y++) {
+    auto prev = &raw[y * rowBytes];
+    auto cur = &raw[(y + 1) * rowBytes];
+    uint64_t sums[5] = { 0, 0, 0, 0, 0 };
+    for (size_t i = 0; i < rowBytes; i++) {
+      int a = i >= (size_t) channels ? cur[i - channels] : 0;
+      int b = prev[i];
+      int c = i >= (size_t) channels ? prev[i - channels] : 0;
+      uint8_t filtered[5] = {
+        cur[i],
+        (uint8_t) (cur[i] - a),
+        (uint8_t) (cur[i] - b),
+        (uint8_t) (cur[i] - ((a + b) >> 1)),
+        (uint8_t) (cur[i] - paeth(a, b, c)),
+      };
+      for (int f = 0; f < 5; f++) {
+        candidates[f * rowBytes + i] = filtered[f];
+        sums[f] += abs((int8_t) filtered[f]);
+      }
+    }
+    // None if no filter is allowed
+    int best = -1;
+    for (int f = 0; f < 5; f++) {
+      if ((filters & (PNG_FILTER_NONE_FLAG << f)) && (best < 0 || sums[f] < sums[best])) best = f;
+    }
+    best = std::max(best, 0);
+    auto row = &(*out)[y * (rowBytes + 1)];
+    row[0] = best;
+    memcpy(row + 1, &candidates[best * rowBytes], rowBytes);
+  }
+}
+
+// Raw deflate of one strip. Strips but the last end with a sync flush, so
+// they end on a byte boundary and can simply be concatenated.
+static bool deflate_strip(const std::vector<uint8_t>& filtered, int level, bool last, std::vector<uint8_t>* out) {
+  z_stream z = {};
+  if (deflateInit2(&z, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+  // The bound doesn't account for the sync flush marker
+  out->resize(deflateBound(&z, filtered.size()) + 16);
+  z.next_in = (Bytef*) filtered.data();
+  z.avail_in = filtered.size();
+  z.next_out = out->data();
+  z.avail_out = out->size();
+  auto result = deflate(&z, last ? Z_FINISH : Z_SYNC_FLUSH);
+  out->resize(z.total_out);
+  deflateEnd(&z);
+  return z.avail_in == 0 && (last ? result == Z_STREAM_END : result == Z_OK);
+}
+
+static int strip_rows(const SkPixmap& pixmap) {
+  return std::max<int>(1, PNG_STRIP_BYTES / (pixmap.width() * 4 + 1));
+}
+
+// Other formats are left to Skia, which keeps their precision (F16) or
+// writes them as grayscale (A8)
+static bool is_rgb8(const SkPixmap& pixmap) {
+  auto colorType = pixmap.colorType();
+  return colorType == kRGBA_8888_SkColorType || colorType == kBGRA_8888_SkColorType || colorType == kRGB_888x_SkColorType;
+}
+
+bool sk_png_use_parallel(const SkPixmap& pixmap) {
+  return pngThreads != 1 && is_rgb8(pixmap) && pixmap.height() > strip_rows(pixmap);
+}
+
+bool sk_encode_png_parallel(SkWStream* stream, const SkPixmap& pixmap, int zlibLevel, int filters) {
+  int width = pixmap.width();
+  int height = pixmap.height();
+  int stripRows = strip_rows(pixmap);
+  int count = (height + stripRows - 1) / stripRows;
+  // Opaque images are written without alpha, like Skia does
+  int channels = pixmap.isOpaque() ? 3 : 4;
+  int threads = pngThreads;
+  if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min(threads, count);
+
+  std::vector<png_strip> strips(count);
+  std::mutex mutex;
+  std::condition_variable stripDone;
+  std::atomic<int> next { 0 };
+  std::atomic<bool> failed { false };
+  auto run = [&] {
+    std::vector<uint8_t> filtered;
+    for (int i = next++; i < count; i = next++) {
+      int top = i * stripRows;
+      filter_strip(pixmap, top, std::min(stripRows, height - top), channels, filters, &filtered);
+      std::vector<uint8_t> deflated;
+      if (!deflate_strip(filtered, zlibLevel, i == count - 1, &deflated)) failed = true;
+      auto adler = adler32(adler32(0, nullptr, 0), filtered.data(), filtered.size());
+      std::lock_guard<std::mutex> lock(mutex);
+      strips[i] = { std::move(deflated), adler, filtered.size(), true };
+      stripDone.notify_all();
+    }
+  };
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; i++) workers.emplace_back(run);
+
+  // Strips are written in order as they complete, one IDAT chunk each
+  static const uint8_t signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+  uint8_t ihdr[13];
+  put_u32(ihdr, width);
+  put_u32(ihdr + 4, height);
+  // 8 bit RGBA or RGB, deflate, adaptive filtering, not interlaced
+  ihdr[8] = 8;
+  ihdr[9] = channels == 4 ? 6 : 2;
+  ihdr[10] = ihdr[11] = ihdr[12] = 0;
+  bool ok = stream->write(signature, 8) && write_chunk(stream, "IHDR", ihdr, 13);
+
+  auto adler = adler32(0, nullptr, 0);
+  for (int i = 0; i < count && ok; i++) {
+    png_strip strip;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      stripDone.wait(lock, [&] { return strips[i].done; });
+      strip = std::move(strips[i]);
+    }
+    if (failed) break;
+    adler = adler32_combine(adler, strip.adler, strip.size);
+    auto& data = strip.deflated;
+    // zlib header for the default window, the second byte (with the level
+    // as a hint) is what zlib itself writes
+    if (i == 0) {
+      uint8_t flags = zlibLevel < 2 ? 0x01 : zlibLevel < 6 ? 0x5e : zlibLevel == 6 ? 0x9c : 0xda;
+      data.insert(data.begin(), { 0x78, flags });
+    }
+    if (i == count - 1) {
+      data.resize(data.size() + 4);
+      put_u32(&data[data.size() - 4], adler);
+    }
+    ok = write_chunk(stream, "IDAT", data.data(), data.size());
+  }
+  // Let the workers run out of strips if writing stopped early
+  next = count;
+  for (auto& worker : workers) worker.join();
+  if (failed || !ok) return false;
+  return write_chunk(stream, "IEND", nullptr, 0);
+}
+
+#else
+
+bool sk_png_use_parallel(const SkPixmap& pixmap) {
+  return false;
+}
+
+bool sk_encode_png_parallel(SkWStream* stream, const SkPixmap& pixmap, int zlibLevel, int filters) {
+  return false;
+}
+
+#endif
+
+extern "C" {
+  void sk_png_set_threads(int threads) {
+    pngThreads = threads;
+  }
+
+  int sk_png_get_threads() {
+    return pngThreads;
+  }
+}
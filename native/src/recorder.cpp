@@ -0,0 +1,195 @@
+#include "include/recorder.hpp"
+#include "include/font.hpp"
+#include "include/core/SkImage.h"
+#include "include/core/SkSerialProcs.h"
+#include "include/core/SkStream.h"
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+extern sk_sp<SkFontMgr> fontMgr;
+extern sk_sp<FontIndexProvider> assets;
+
+/// Serialization
+
+// Pictures are serialized with hooks for typefaces and images, each record
+// starting with a tag byte:
+//
+// - 'R' references a typeface by family and style (weight, width and slant
+//   as native-endian i32), resolved against the registered fonts on load.
+//   Only used when that lookup gives back the same typeface.
+// - 'E' embeds a typeface that can't be referenced.
+// - 'I' is an encoded image, 'D' refers back to an earlier one by index
+//   (i32), so identical images are only stored once.
+//
+// The data is meant for a local cache, it isn't portable across machines.
+
+typedef struct sk_picture_serial {
+  // Image unique IDs and content hashes to indices in `images`
+  std::unordered_map<uint32_t, int> imageIds;
+  std::unordered_multimap<size_t, int> imageHashes;
+  std::vector<sk_sp<SkData>> images;
+} sk_picture_serial;
+
+typedef struct sk_picture_deserial {
+  std::vector<sk_sp<SkImage>> images;
+} sk_picture_deserial;
+
+static sk_sp<SkTypeface> match_typeface(const char* family, const SkFontStyle& style) {
+  std::shared_lock<std::shared_mutex> lock(fontLock);
+  sk_sp<SkTypeface> typeface(assets->matchFamilyStyle(family, style));
+  if (typeface == nullptr) typeface.reset(fontMgr->matchFamilyStyle(family, style));
+  return typeface;
+}
+
+static sk_sp<SkData> serialize_typeface(SkTypeface* typeface, void* ctx) {
+  SkString family;
+  typeface->getFamilyName(&family);
+  auto style = typeface->fontStyle();
+  auto match = match_typeface(family.c_str(), style);
+
+  SkDynamicMemoryWStream stream;
+  if (match != nullptr && match->uniqueID() == typeface->uniqueID()) {
+    stream.write8('R');
+    stream.write32(style.weight());
+    stream.write32(style.width());
+    stream.write32(style.slant());
+    stream.writeText(family.c_str());
+  } else {
+    stream.write8('E');
+    typeface->serialize(&stream, SkTypeface::SerializeBehavior::kDoIncludeData);
+  }
+  return stream.detachAsData();
+}
+
+static sk_sp<SkTypeface> deserialize_typeface(const void* data, size_t length, void* ctx) {
+  auto bytes = (const uint8_t*) data;
+  if (length > 1 && bytes[0] == 'E') {
+    SkMemoryStream stream(bytes + 1, length - 1);
+    return SkTypeface::MakeDeserialize(&stream);
+  }
+  if (length < 13 || bytes[0] != 'R') return nullptr;
+  int32_t weight, width, slant;
+  memcpy(&weight, bytes + 1, 4);
+  memcpy(&width, bytes + 5, 4);
+  memcpy(&slant, bytes + 9, 4);
+  SkString family((const char*) bytes + 13, length - 13);
+  return match_typeface(family.c_str(), SkFontStyle(weight, width, (SkFontStyle::Slant) slant));
+}
+
+static sk_sp<SkData> serialize_image(SkImage* image, void* ctx) {
+  auto serial = (sk_picture_serial*) ctx;
+  SkDynamicMemoryWStream stream;
+
+  auto known = serial->imageIds.find(image->uniqueID());
+  if (known != serial->imageIds.end()) {
+    stream.write8('D');
+    stream.write32(known->second);
+    return stream.detachAsData();
+  }
+
+  // Images loaded from files keep their encoded data, others become PNG
+  auto encoded = image->refEncodedData();
+  if (encoded == nullptr) encoded = image->encodeToData(SkEncodedImageFormat::kPNG, 100);
+  if (encoded == nullptr) return nullptr;
+
+  auto hash = std::hash<std::string_view>()(std::string_view((const char*) encoded->data(), encoded->size()));
+  auto range = serial->imageHashes.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (serial->images[it->second]->equals(encoded.get())) {
+      serial->imageIds[image->uniqueID()] = it->second;
+      stream.write8('D');
+      stream.write32(it->second);
+      return stream.detachAsData();
+    }
+  }
+
+  int index = serial->images.size();
+  serial->images.push_back(encoded);
+  serial->imageHashes.emplace(hash, index);
+  serial->imageIds[image->uniqueID()] = index;
+  stream.write8('I');
+  stream.write(encoded->data(), encoded->size());
+  return stream.detachAsData();
+}
+
+static sk_sp<SkImage> deserialize_image(const void* data, size_t length, void* ctx) {
+  auto deserial = (sk_picture_deserial*) ctx;
+  auto bytes = (const uint8_t*) data;
+  if (length >= 5 && bytes[0] == 'D') {
+    int32_t index;
+    memcpy(&index, bytes + 1, 4);
+    if (index < 0 || index >= (int) deserial->images.size()) return nullptr;
+    return deserial->images[index];
+  }
+  if (length < 2 || bytes[0] != 'I') return nullptr;
+  // Decoded lazily, when first drawn
+  auto image = SkImage::MakeFromEncoded(SkData::MakeWithCopy(bytes + 1, length - 1));
+  deserial->images.push_back(image);
+  return image;
+}
+
+extern "C" {
+  sk_recorder* sk_recorder_create(float width, float height) {
+    auto recorder = new sk_recorder();
+    recorder->recorder = new SkPictureRecorder();
+    auto canvas = recorder->recorder->beginRecording(SkRect::MakeWH(width, height));
+    recorder->context = create_context(canvas);
+    return recorder;
+  }
+
+  void sk_recorder_destroy(sk_recorder* recorder) {
+    if (recorder->context != nullptr) sk_context_destroy(recorder->context);
+    delete recorder->recorder;
+    delete recorder;
+  }
+
+  sk_context* sk_recorder_get_context(sk_recorder* recorder) {
+    return recorder->context;
+  }
+
+  // Ends the recording, the context can't be used afterwards. The picture
+  // is owned by the caller, see sk_picture_destroy.
+  SkPicture* sk_recorder_finish(sk_recorder* recorder) {
+    if (recorder->context == nullptr) return nullptr;
+    sk_context_destroy(recorder->context);
+    recorder->context = nullptr;
+    return recorder->recorder->finishRecordingAsPicture().release();
+  }
+
+  void sk_picture_destroy(SkPicture* picture) {
+    picture->unref();
+  }
+
+  // Writes [x, y, width, height] of the recorded area to out
+  void sk_picture_get_bounds(SkPicture* picture, float* out) {
+    auto rect = picture->cullRect();
+    out[0] = rect.x();
+    out[1] = rect.y();
+    out[2] = rect.width();
+    out[3] = rect.height();
+  }
+
+  SkData* sk_picture_serialize(SkPicture* picture, const void** buffer, unsigned int* size) {
+    sk_picture_serial serial;
+    SkSerialProcs procs;
+    procs.fTypefaceProc = serialize_typeface;
+    procs.fImageProc = serialize_image;
+    procs.fImageCtx = &serial;
+    auto data = picture->serialize(&procs).release();
+    *buffer = data->data();
+    *size = data->size();
+    return data;
+  }
+
+  // Returns null if the data isn't a valid picture
+  SkPicture* sk_picture_deserialize(const void* data, size_t length) {
+    sk_picture_deserial deserial;
+    SkDeserialProcs procs;
+    procs.fTypefaceProc = deserialize_typeface;
+    procs.fImageProc = deserialize_image;
+    procs.fImageCtx = &deserial;
+    return SkPicture::MakeFromData(data, length, &procs).release();
+  }
+}
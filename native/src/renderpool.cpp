@@ -0,0 +1,126 @@
+#include "include/renderpool.hpp"
+#include "include/context2d.hpp"
+#include "include/core/SkImage.h"
+#include "include/core/SkSurface.h"
+#include <algorithm>
+
+static sk_sp<SkData> sk_render_job_run(const sk_render_job& job) {
+  auto surface = SkSurface::MakeRasterN32Premul(job.width, job.height);
+  if (surface == nullptr) return nullptr;
+  if (job.picture != nullptr) {
+    auto canvas = surface->getCanvas();
+    auto bounds = job.picture->cullRect();
+    canvas->scale(job.width / bounds.width(), job.height / bounds.height());
+    canvas->translate(-bounds.x(), -bounds.y());
+    canvas->drawPicture(job.picture);
+  } else {
+    auto context = create_context(surface->getCanvas());
+    sk_context_execute(context, job.ops.data(), job.ops.size());
+    sk_context_destroy(context);
+  }
+  return surface->makeImageSnapshot()->encodeToData(format_from_int(job.format), job.quality);
+}
+
+static void sk_render_pool_run(sk_render_pool* pool) {
+  while (true) {
+    sk_render_job job;
+    {
+      std::unique_lock<std::mutex> lock(pool->mutex);
+      pool->jobsReady.wait(lock, [pool] { return pool->stopping || !pool->jobs.empty(); });
+      if (pool->stopping) return;
+      job = std::move(pool->jobs.front());
+      pool->jobs.pop_front();
+    }
+    auto data = sk_render_job_run(job);
+    {
+      std::lock_guard<std::mutex> lock(pool->mutex);
+      pool->results.push_back({ job.id, std::move(data) });
+    }
+    pool->resultsReady.notify_all();
+  }
+}
+
+extern "C" {
+  // Creates a pool with the given number of threads, or one per core if 0
+  sk_render_pool* sk_render_pool_create(int threads) {
+    if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    auto pool = new sk_render_pool();
+    pool->threads.reserve(threads);
+    for (int i = 0; i < threads; i++) {
+      pool->threads.emplace_back(sk_render_pool_run, pool);
+    }
+    return pool;
+  }
+
+  // Drops queued jobs, waits for the running ones and wakes up any waiter
+  void sk_render_pool_destroy(sk_render_pool* pool) {
+    {
+      std::lock_guard<std::mutex> lock(pool->mutex);
+      pool->stopping = true;
+    }
+    pool->jobsReady.notify_all();
+    pool->resultsReady.notify_all();
+    for (auto& thread : pool->threads) thread.join();
+    delete pool;
+  }
+
+  int sk_render_pool_thread_count(sk_render_pool* pool) {
+    return pool->threads.size();
+  }
+
+  // Copies the commands and queues them, returns the id of the job
+  uint32_t sk_render_pool_submit(sk_render_pool* pool, const uint8_t* ops, size_t len, int width, int height, int format, int quality) {
+    uint32_t id;
+    {
+      std::lock_guard<std::mutex> lock(pool->mutex);
+      id = pool->nextId++;
+      pool->jobs.push_back({ id, width, height, format, quality, nullptr, std::vector<uint8_t>(ops, ops + len) });
+      pool->pending++;
+    }
+    pool->jobsReady.notify_one();
+    return id;
+  }
+
+  // Queues a picture to be scaled to width x height, pictures are immutable
+  // so the job only takes a reference
+  uint32_t sk_render_pool_submit_picture(sk_render_pool* pool, SkPicture* picture, int width, int height, int format, int quality) {
+    uint32_t id;
+    {
+      std::lock_guard<std::mutex> lock(pool->mutex);
+      id = pool->nextId++;
+      pool->jobs.push_back({ id, width, height, format, quality, sk_ref_sp(picture), {} });
+      pool->pending++;
+    }
+    pool->jobsReady.notify_one();
+    return id;
+  }
+
+  // Blocks until a result is ready to be polled, or nothing is pending.
+  // Called as a nonblocking FFI symbol, returns the number of ready results.
+  int sk_render_pool_wait(sk_render_pool* pool) {
+    std::unique_lock<std::mutex> lock(pool->mutex);
+    pool->resultsReady.wait(lock, [pool] {
+      return pool->stopping || !pool->results.empty() || pool->pending == 0;
+    });
+    return pool->results.size();
+  }
+
+  // Takes the oldest finished job without blocking. Returns 0 if there is
+  // none, otherwise 1 with the encoded image in bytes/size, owned by data
+  // (null if rendering failed) until freed with sk_data_free.
+  int sk_render_pool_poll(sk_render_pool* pool, uint32_t* id, int* size, const void** bytes, SkData** data) {
+    sk_render_result result;
+    {
+      std::lock_guard<std::mutex> lock(pool->mutex);
+      if (pool->results.empty()) return 0;
+      result = std::move(pool->results.front());
+      pool->results.pop_front();
+      pool->pending--;
+    }
+    *id = result.id;
+    *size = result.data == nullptr ? 0 : result.data->size();
+    *bytes = result.data == nullptr ? nullptr : result.data->data();
+    *data = result.data.release();
+    return 1;
+  }
+}
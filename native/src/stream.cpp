@@ -0,0 +1,291 @@
+#include "include/stream.hpp"
+#include "include/png.hpp"
+#include "include/encode/SkJpegEncoder.h"
+#include "include/encode/SkPngEncoder.h"
+#include "include/encode/SkWebpEncoder.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <io.h>
+#define write_fd _write
+#else
+#include <unistd.h>
+#define write_fd ::write
+#endif
+
+static std::atomic<bool> encodeCacheEnabled { true };
+
+bool sk_encode_pixmap(SkWStream* stream, const SkPixmap& pixmap, const sk_encode_options& options) {
+  switch (format_from_int(options.format)) {
+    case SkEncodedImageFormat::kPNG: {
+      SkPngEncoder::Options png;
+      if (options.zlibLevel >= 0) png.fZLibLevel = std::min(options.zlibLevel, 9);
+      if (options.filters >= 0) png.fFilterFlags = (SkPngEncoder::FilterFlag) options.filters;
+      if (sk_png_use_parallel(pixmap)) {
+        return sk_encode_png_parallel(stream, pixmap, png.fZLibLevel, (int) png.fFilterFlags);
+      }
+      return SkPngEncoder::Encode(stream, pixmap, png);
+    }
+    case SkEncodedImageFormat::kJPEG: {
+      SkJpegEncoder::Options jpeg;
+      jpeg.fQuality = options.quality;
+      if (options.downsample >= 0) jpeg.fDownsample = (SkJpegEncoder::Downsample) options.downsample;
+      return SkJpegEncoder::Encode(stream, pixmap, jpeg);
+    }
+    case SkEncodedImageFormat::kWEBP: {
+      // For lossless WebP the quality is how hard the encoder tries
+      SkWebpEncoder::Options webp;
+      if (options.lossless >= 0 ? options.lossless : options.quality == 100) {
+        webp.fCompression = SkWebpEncoder::Compression::kLossless;
+        webp.fQuality = options.effort >= 0 ? options.effort : 75;
+      } else {
+        webp.fCompression = SkWebpEncoder::Compression::kLossy;
+        webp.fQuality = options.quality;
+      }
+      return SkWebpEncoder::Encode(stream, pixmap, webp);
+    }
+    default:
+      return false;
+  }
+}
+
+bool sk_encode_pixmap(SkWStream* stream, const SkPixmap& pixmap, int format, int quality) {
+  sk_encode_options options = { format, quality, -1, -1, -1, -1, -1 };
+  return sk_encode_pixmap(stream, pixmap, options);
+}
+
+sk_sp<SkImage> sk_canvas_snapshot(sk_canvas* canvas) {
+  // A snapshot sharing locked pixels would make the next draw copy them into
+  // new pixels for the surface, leaving JS with a view of pixels owned by
+  // the snapshot, freed along with it
+  if (canvas->pixelsLocked) {
+    SkPixmap pixmap;
+    if (canvas->surface->peekPixels(&pixmap)) return SkImage::MakeRasterCopy(pixmap);
+  }
+  return canvas->surface->makeImageSnapshot();
+}
+
+sk_sp<SkImage> sk_canvas_raster_snapshot(sk_canvas* canvas) {
+  auto image = sk_canvas_snapshot(canvas);
+  if (image != nullptr && canvas->backend != kBackendCPU) image = image->makeRasterImage();
+  return image;
+}
+
+bool FDWStream::write(const void* buffer, size_t size) {
+  auto bytes = (const char*) buffer;
+  while (size > 0) {
+    auto count = write_fd(fd, bytes, (unsigned int) size);
+    if (count < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    bytes += count;
+    size -= count;
+    written += count;
+  }
+  return true;
+}
+
+bool ChunkWStream::write(const void* buffer, size_t size) {
+  auto bytes = (const uint8_t*) buffer;
+  written += size;
+  while (size > 0) {
+    auto count = std::min(size, kChunkSize - current.size());
+    current.insert(current.end(), bytes, bytes + count);
+    bytes += count;
+    size -= count;
+    if (current.size() == kChunkSize) {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [this] { return cancelled || chunks.size() < kMaxChunks; });
+      if (cancelled) return false;
+      chunks.push_back(std::move(current));
+      current = std::vector<uint8_t>();
+      current.reserve(kChunkSize);
+      changed.notify_all();
+    }
+  }
+  return true;
+}
+
+void ChunkWStream::flush() {
+  if (current.empty()) return;
+  std::lock_guard<std::mutex> lock(mutex);
+  chunks.push_back(std::move(current));
+  current = std::vector<uint8_t>();
+  changed.notify_all();
+}
+
+void ChunkWStream::finish(bool success) {
+  flush();
+  std::lock_guard<std::mutex> lock(mutex);
+  done = true;
+  failed = !success;
+  changed.notify_all();
+}
+
+// Blocks until bytes can be read. Returns 1 if there are, 0 once everything
+// was read and -1 if encoding failed.
+int ChunkWStream::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [this] { return done || !chunks.empty(); });
+  if (!chunks.empty()) return 1;
+  return failed ? -1 : 0;
+}
+
+// Copies up to capacity queued bytes to out without blocking, returns the
+// number of bytes copied.
+int ChunkWStream::read(uint8_t* out, int capacity) {
+  std::lock_guard<std::mutex> lock(mutex);
+  int total = 0;
+  while (total < capacity && !chunks.empty()) {
+    auto& chunk = chunks.front();
+    auto count = std::min((size_t) (capacity - total), chunk.size() - readOffset);
+    memcpy(out + total, chunk.data() + readOffset, count);
+    total += count;
+    readOffset += count;
+    if (readOffset == chunk.size()) {
+      chunks.pop_front();
+      readOffset = 0;
+    }
+  }
+  changed.notify_all();
+  return total;
+}
+
+void ChunkWStream::cancel() {
+  std::lock_guard<std::mutex> lock(mutex);
+  cancelled = true;
+  changed.notify_all();
+}
+
+extern "C" {
+  // Canvas.save() to a file descriptor, which is left open
+  int sk_canvas_save_fd(sk_canvas* canvas, int fd, int format, int quality) {
+    auto image = sk_canvas_raster_snapshot(canvas);
+    SkPixmap pixmap;
+    if (image == nullptr || !image->peekPixels(&pixmap)) return 0;
+    FDWStream stream(fd);
+    return sk_encode_pixmap(&stream, pixmap, format, quality);
+  }
+
+  // Starts encoding a snapshot of the canvas on a new thread, the canvas
+  // can be drawn on meanwhile. The bytes are read with
+  // sk_encode_stream_wait/read.
+  sk_encode_stream* sk_canvas_encode_stream(sk_canvas* canvas, int format, int quality) {
+    auto image = sk_canvas_raster_snapshot(canvas);
+    if (image == nullptr) return nullptr;
+    auto stream = new sk_encode_stream();
+    stream->thread = std::thread([stream, image, format, quality] {
+      SkPixmap pixmap;
+      auto success = image->peekPixels(&pixmap) && sk_encode_pixmap(&stream->stream, pixmap, format, quality);
+      stream->stream.finish(success);
+    });
+    return stream;
+  }
+
+  // Called as a nonblocking FFI symbol, see ChunkWStream::wait
+  int sk_encode_stream_wait(sk_encode_stream* stream) {
+    return stream->stream.wait();
+  }
+
+  int sk_encode_stream_read(sk_encode_stream* stream, uint8_t* out, int capacity) {
+    return stream->stream.read(out, capacity);
+  }
+
+  // Stops encoding if still running
+  void sk_encode_stream_destroy(sk_encode_stream* stream) {
+    stream->stream.cancel();
+    stream->thread.join();
+    delete stream;
+  }
+
+  // sk_canvas_encode_image with all encoder settings. The last few encoded
+  // images are kept until the canvas is drawn on, encoding again with the
+  // same settings and PNG thread count returns another reference to the same
+  // data. The cache is bypassed while JS has the pixels locked, and for
+  // canvases drawing into pixels owned by JS, as its writes don't change the
+  // content generation. It can also be turned off.
+  const void* sk_canvas_encode_image_ex(sk_canvas* canvas, const sk_encode_options* options, int* size, SkData** data) {
+    auto& cache = canvas->encodeCache;
+    auto generation = canvas->surface->generationID();
+    if (generation != canvas->encodeCacheGeneration) {
+      cache.clear();
+      canvas->encodeCacheGeneration = generation;
+    }
+    bool useCache = encodeCacheEnabled && !canvas->pixelsLocked && !canvas->direct;
+    auto threads = sk_png_get_threads();
+    auto cached = !useCache ? cache.end() : std::find_if(cache.begin(), cache.end(), [options, threads](const sk_encoded_image& entry) {
+      return entry.pngThreads == threads && memcmp(&entry.options, options, sizeof(sk_encode_options)) == 0;
+    });
+
+    sk_sp<SkData> buf;
+    if (cached != cache.end()) {
+      canvas->encodeCacheHits++;
+      buf = cached->data;
+    } else {
+      canvas->encodeCacheMisses++;
+      auto image = sk_canvas_raster_snapshot(canvas);
+      SkPixmap pixmap;
+      SkDynamicMemoryWStream stream;
+      if (image == nullptr || !image->peekPixels(&pixmap)) return nullptr;
+      if (!sk_encode_pixmap(&stream, pixmap, *options)) return nullptr;
+      buf = stream.detachAsData();
+      if (useCache) {
+        if (cache.size() == ENCODE_CACHE_ENTRIES) cache.erase(cache.begin());
+        cache.push_back({ *options, threads, buf });
+      }
+    }
+    auto ptr = buf->data();
+    *size = buf->size();
+    *data = buf.release();
+    return ptr;
+  }
+
+  // Like sk_canvas_encode_image_ex, but encodes on a new thread. The
+  // snapshot shares the canvas pixels until the next draw copies them, so
+  // the canvas can be drawn on meanwhile without affecting the result.
+  sk_encode_job* sk_canvas_encode_image_async(sk_canvas* canvas, const sk_encode_options* options) {
+    auto image = sk_canvas_raster_snapshot(canvas);
+    if (image == nullptr) return nullptr;
+    auto job = new sk_encode_job();
+    job->thread = std::thread([job, image, options = *options] {
+      SkPixmap pixmap;
+      SkDynamicMemoryWStream stream;
+      if (image->peekPixels(&pixmap) && sk_encode_pixmap(&stream, pixmap, options)) {
+        job->data = stream.detachAsData();
+      }
+    });
+    return job;
+  }
+
+  // Called as a nonblocking FFI symbol, returns 1 once encoded or 0 if
+  // encoding failed
+  int sk_encode_job_wait(sk_encode_job* job) {
+    if (job->thread.joinable()) job->thread.join();
+    return job->data != nullptr;
+  }
+
+  // Hands the encoded bytes over like sk_canvas_encode_image and frees the
+  // job, which must not be used afterwards
+  const void* sk_encode_job_finish(sk_encode_job* job, int* size, SkData** data) {
+    sk_encode_job_wait(job);
+    auto buf = std::move(job->data);
+    delete job;
+    if (buf == nullptr) return nullptr;
+    auto ptr = buf->data();
+    *size = buf->size();
+    *data = buf.release();
+    return ptr;
+  }
+
+  void sk_encode_cache_set_enabled(int enabled) {
+    encodeCacheEnabled = enabled != 0;
+  }
+
+  int sk_encode_cache_get_enabled() {
+    return encodeCacheEnabled;
+  }
+}
@@ -21,12 +21,7 @@ extern "C" {
   }
 
   SKIA_EXPORT sk_context* sk_svg_get_context(sk_svg* svg) {
-    sk_context* ctx = new sk_context();
-    ctx->canvas = svg->canvas;
-    ctx->path = new SkPath();
-    ctx->state = create_default_state();
-    ctx->states = std::vector<sk_context_state*>();
-    return ctx;
+    return create_context(svg->canvas);
   }
 
   SKIA_EXPORT int sk_svg_write_file(sk_svg* svg, char* path) {
@@ -0,0 +1,141 @@
+#include "include/textcache.hpp"
+#include <atomic>
+#include <cstring>
+#include <list>
+#include <unordered_map>
+
+// Rough cost of a cached paragraph: fixed overhead plus shaping results
+// (glyphs, positions, clusters) per byte of text. Only used for the budget.
+#define TEXT_CACHE_ENTRY_BYTES 1024
+#define TEXT_CACHE_BYTES_PER_CHAR 64
+
+typedef struct sk_text_key_header {
+  const char* family;
+  float size;
+  uint32_t weight;
+  int style;
+  int stretch;
+  float letterSpacing;
+  float wordSpacing;
+  int direction;
+} sk_text_key_header;
+
+typedef struct sk_text_cache_entry {
+  std::shared_ptr<sk_text_layout> layout;
+  std::list<std::string>::iterator lru;
+  size_t bytes;
+} sk_text_cache_entry;
+
+// Cached paragraphs are repainted with the paint of each call, so they
+// can't be shared between threads: every thread has its own cache, sharing
+// the budget and settings. Clearing bumps the generation, which makes each
+// cache drop its entries on its next use.
+typedef struct sk_text_cache {
+  size_t usedBytes;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t generation;
+  // Most recently used first
+  std::list<std::string> lru;
+  std::unordered_map<std::string, sk_text_cache_entry> entries;
+} sk_text_cache;
+
+static std::atomic<bool> fastPath { true };
+static std::atomic<size_t> budget { 8 * 1024 * 1024 };
+static std::atomic<uint64_t> generation { 0 };
+
+static void evict(sk_text_cache* cache, size_t limit) {
+  while (cache->usedBytes > limit && !cache->lru.empty()) {
+    auto it = cache->entries.find(cache->lru.back());
+    cache->usedBytes -= it->second.bytes;
+    cache->entries.erase(it);
+    cache->lru.pop_back();
+  }
+}
+
+static sk_text_cache* thread_cache() {
+  thread_local sk_text_cache cache = {};
+  auto current = generation.load();
+  if (cache.generation != current) {
+    evict(&cache, 0);
+    cache.generation = current;
+  }
+  return &cache;
+}
+
+const std::string& sk_text_cache_key(const Font& font, float letterSpacing, float wordSpacing, int direction, const char* text, int textLen) {
+  thread_local std::string key;
+  sk_text_key_header header;
+  // Zero the padding too, the header is compared bytewise
+  memset(&header, 0, sizeof(header));
+  // Interned families are identified by their pointer, others by their
+  // string, which is appended to the key
+  header.family = font.uninterned ? nullptr : font.family;
+  header.size = font.size;
+  header.weight = font.weight;
+  header.style = font.style;
+  header.stretch = font.stretch;
+  header.letterSpacing = letterSpacing;
+  header.wordSpacing = wordSpacing;
+  header.direction = direction;
+  key.assign((const char*) &header, sizeof(header));
+  if (font.uninterned) key.append(font.family, strlen(font.family) + 1);
+  key.append(text, textLen);
+  return key;
+}
+
+std::shared_ptr<sk_text_layout> sk_text_cache_get(const std::string& key) {
+  auto cache = thread_cache();
+  auto it = cache->entries.find(key);
+  if (it == cache->entries.end()) {
+    cache->misses++;
+    return nullptr;
+  }
+  cache->hits++;
+  cache->lru.splice(cache->lru.begin(), cache->lru, it->second.lru);
+  return it->second.layout;
+}
+
+void sk_text_cache_put(const std::string& key, std::shared_ptr<sk_text_layout> layout, int textLen) {
+  auto cache = thread_cache();
+  size_t limit = budget;
+  size_t bytes = TEXT_CACHE_ENTRY_BYTES + key.size() * 2 + textLen * TEXT_CACHE_BYTES_PER_CHAR;
+  if (bytes > limit || cache->entries.count(key) > 0) return;
+  evict(cache, limit - bytes);
+  cache->lru.push_front(key);
+  cache->entries.emplace(key, sk_text_cache_entry { layout, cache->lru.begin(), bytes });
+  cache->usedBytes += bytes;
+}
+
+bool sk_text_fast_path_enabled() {
+  return fastPath;
+}
+
+extern "C" {
+  void sk_text_set_fast_path(int enabled) {
+    fastPath = enabled != 0;
+    // Layouts from the other path must not be reused
+    sk_text_cache_clear();
+  }
+
+  void sk_text_cache_set_budget(size_t bytes) {
+    budget = bytes;
+    // Other threads shrink their cache on their next insertion
+    evict(thread_cache(), bytes);
+  }
+
+  // Writes [hits, misses, entries, bytes, budget] of the calling thread's
+  // cache to out
+  void sk_text_cache_get_stats(uint64_t* out) {
+    auto cache = thread_cache();
+    out[0] = cache->hits;
+    out[1] = cache->misses;
+    out[2] = cache->entries.size();
+    out[3] = cache->usedBytes;
+    out[4] = budget;
+  }
+
+  void sk_text_cache_clear() {
+    generation++;
+  }
+}
@@ -1,25 +1,79 @@
 import { CanvasRenderingContext2D } from "./context2d.ts";
 import ffi, { cstr, encodeBase64, getBuffer } from "./ffi.ts";
 import type { ColorSpace } from "./image.ts";
+import { PixelMapping } from "./mapping.ts";
+import type { Picture } from "./recorder.ts";
 
 const {
   sk_canvas_create,
   sk_canvas_create_gl,
+  sk_canvas_create_direct,
+  sk_canvas_create_typed,
+  sk_canvas_get_color_type,
+  sk_canvas_set_opaque,
   sk_canvas_destroy,
   sk_canvas_save,
   sk_canvas_read_pixels,
-  sk_canvas_encode_image,
+  sk_canvas_encode_image_ex,
+  sk_canvas_encode_cache_get_stats,
+  sk_encode_cache_set_enabled,
+  sk_encode_cache_get_enabled,
+  sk_canvas_lock_pixels,
+  sk_canvas_unlock_pixels,
   sk_data_free,
   sk_canvas_get_context,
   sk_canvas_flush,
   sk_canvas_set_size,
+  sk_canvas_draw_picture_tiled,
+  sk_canvas_render_to_file,
+  sk_canvas_save_fd,
+  sk_canvas_encode_stream,
+  sk_encode_stream_wait,
+  sk_encode_stream_read,
+  sk_encode_stream_destroy,
+  sk_png_set_threads,
+  sk_png_get_threads,
+  sk_canvas_encode_image_async,
+  sk_encode_job_wait,
+  sk_encode_job_finish,
 } = ffi;
 
+/** Matches the chunk size of the native encode stream. */
+const ENCODE_CHUNK_SIZE = 64 * 1024;
+
+// Stops the encoding thread of streams dropped before being fully read
+const ENCODE_STREAM_FINALIZER = new FinalizationRegistry(
+  (ptr: Deno.PointerValue) => {
+    sk_encode_stream_destroy(ptr);
+  },
+);
+
+/** Options of `Canvas.renderToFile`. */
+export interface RenderToFileOptions {
+  /** Width of the image, the picture is scaled to it. */
+  width?: number;
+  /** Height of the image, the picture is scaled to it. */
+  height?: number;
+  /** Only "png" and "jpeg" can be written in strips. */
+  format?: ImageFormat;
+  quality?: number;
+  /** Rows rendered at a time, 256 by default. */
+  stripHeight?: number;
+}
+
+/** Options of `Canvas#drawPictureTiled`. */
+export interface TiledDrawOptions {
+  /** Size of the square tiles in pixels, 512 by default. */
+  tileSize?: number;
+  /** Number of threads drawing tiles, one per core by default. */
+  threads?: number;
+}
+
 const CANVAS_FINALIZER = new FinalizationRegistry((ptr: Deno.PointerValue) => {
   sk_canvas_destroy(ptr);
 });
 
-enum CFormat {
+export enum CFormat {
   png = 0,
   jpeg = 1,
   webp = 2,
@@ -27,6 +81,155 @@ enum CFormat {
 
 export type ImageFormat = keyof typeof CFormat;
 
+/** PNG row filters, see `EncodeOptions.filters`. */
+export enum CPngFilter {
+  none = 0x08,
+  sub = 0x10,
+  up = 0x20,
+  avg = 0x40,
+  paeth = 0x80,
+}
+
+/** JPEG chroma subsampling, see `EncodeOptions.chromaSubsampling`. */
+export enum CChromaSubsampling {
+  "4:2:0" = 0,
+  "4:2:2" = 1,
+  "4:4:4" = 2,
+}
+
+/**
+ * Encoder settings of `Canvas#encode`. Settings which don't apply to the
+ * format are ignored.
+ */
+export interface EncodeOptions {
+  /** JPEG and lossy WebP quality from 0 to 100, 100 by default. */
+  quality?: number;
+  /** PNG zlib compression level from 0 (fastest) to 9, 6 by default. */
+  compressionLevel?: number;
+  /**
+   * PNG filters each row is allowed to use, all by default. The encoder
+   * picks the one that likely compresses best. Fewer filters encode faster,
+   * `["none"]` is the fastest.
+   */
+  filters?: (keyof typeof CPngFilter)[];
+  /** WebP: whether to compress losslessly, by default if quality is 100. */
+  lossless?: boolean;
+  /** Lossless WebP: effort from 0 (fastest) to 100, 75 by default. */
+  effort?: number;
+  /** JPEG chroma subsampling, "4:2:0" by default. */
+  chromaSubsampling?: keyof typeof CChromaSubsampling;
+}
+
+/**
+ * Pixel formats of canvases, keep in sync with `color_type_from_int` in
+ * native/src/common.cpp.
+ */
+export enum CColorType {
+  rgba8888,
+  bgra8888,
+  alpha8,
+  rgb565,
+  rgbaF16,
+  rgb888x,
+}
+
+export type ColorType = keyof typeof CColorType;
+
+/** Same values as `SkAlphaType`. */
+export enum CAlphaType {
+  unknown,
+  opaque,
+  premul,
+  unpremul,
+}
+
+export type AlphaType = keyof typeof CAlphaType;
+
+/** Options of `new Canvas` and `createCanvas`. */
+export interface CanvasOptions {
+  /** Whether the canvas is GPU backed, see `createCanvas`. */
+  gpu?: boolean;
+  /**
+   * Format of the pixels of a raster canvas, the platform's 32-bit format
+   * by default. "alpha8" keeps only coverage, for masks, at a quarter of
+   * the memory. "rgb565" and "rgb888x" are opaque, 565 at half the memory.
+   * "rgbaF16" has half-float channels for high dynamic range, at twice the
+   * memory.
+   */
+  colorType?: ColorType;
+  /**
+   * False for an opaque raster canvas, same as
+   * `getContext("2d", { alpha: false })`.
+   */
+  alpha?: boolean;
+}
+
+/** Attributes of `Canvas#getContext`. */
+export interface CanvasRenderingContext2DSettings {
+  /**
+   * False makes the canvas opaque: it starts out black, clearRect clears to
+   * black, blending skips what is below, and PNG and WebP are encoded
+   * without an alpha channel. Only applies to the first `getContext` call
+   * of a raster canvas, before anything was drawn.
+   */
+  alpha?: boolean;
+}
+
+/** Bytes per pixel of each `CColorType`. */
+const BYTES_PER_PIXEL = [4, 4, 1, 2, 8, 4];
+
+/** Options of `Canvas.fromPixels`. */
+export interface FromPixelsOptions {
+  /** Format of the pixels, the platform's 32-bit format by default. */
+  colorType?: ColorType;
+  /** Bytes from one row to the next, at least `width` pixels. */
+  rowBytes?: number;
+}
+
+/** Direct access to the pixels of a canvas, see `Canvas#lockPixels`. */
+export interface LockedPixels {
+  /**
+   * The pixels themselves, `rowBytes * height` bytes in the canvas' own
+   * format. Detached once unlocked.
+   */
+  data: Uint8Array;
+  width: number;
+  height: number;
+  rowBytes: number;
+  colorType: ColorType;
+  alphaType: AlphaType;
+  /** Ends access to the pixels, written pixels are seen by later draws. */
+  unlock(): void;
+}
+
+/** Counters of the encoded image cache, see `Canvas#encodeCacheStats`. */
+export interface EncodeCacheStats {
+  hits: number;
+  misses: number;
+  entries: number;
+  /** Size of the cached encoded images. */
+  bytes: number;
+}
+
+/** Packs encoder settings as `sk_encode_options`, -1 being the default. */
+function encodeOptions(
+  format: ImageFormat,
+  options: number | EncodeOptions,
+): Int32Array {
+  if (typeof options === "number") options = { quality: options };
+  return new Int32Array([
+    CFormat[format],
+    options.quality ?? 100,
+    options.compressionLevel ?? -1,
+    options.filters?.reduce((flags, f) => flags | CPngFilter[f], 0) ?? -1,
+    options.lossless === undefined ? -1 : Number(options.lossless),
+    options.effort ?? -1,
+    options.chromaSubsampling === undefined
+      ? -1
+      : CChromaSubsampling[options.chromaSubsampling],
+  ]);
+}
+
 const OUT_SIZE = new Uint32Array(1);
 const OUT_SIZE_PTR = new Uint8Array(OUT_SIZE.buffer);
 const OUT_DATA = new BigUint64Array(1);
@@ -39,10 +242,15 @@ const SK_DATA_FINALIZER = new FinalizationRegistry(
 );
 
 const _ptr = Symbol("[[ptr]]");
+const _pointer = Symbol("[[pointer]]");
 const _width = Symbol("[[width]]");
 const _height = Symbol("[[height]]");
 const _gpu = Symbol("[[gpu]]");
 const _ctx = Symbol("[[ctx]]");
+const _locked = Symbol("[[locked]]");
+const _pixels = Symbol("[[pixels]]");
+const _init = Symbol("[[init]]");
+const _ctxRequested = Symbol("[[ctxRequested]]");
 
 /**
  * Canvas is an offscreen surface that can be drawn to.
@@ -55,16 +263,59 @@ const _ctx = Symbol("[[ctx]]");
  * @link https://developer.mozilla.org/en-US/docs/Web/API/Canvas_API
  */
 export class Canvas {
-  [_ptr]: Deno.PointerValue;
+  [_pointer]: Deno.PointerValue = null;
   [_width]: number;
   [_height]: number;
   [_gpu] = false;
   [_ctx]: CanvasRenderingContext2D;
+  [_locked]: LockedPixels | null = null;
+  // Memory drawn into by canvases from `fromPixels`, kept alive with them
+  [_pixels]: Uint8Array | PixelMapping | null = null;
+  // Set by the first getContext call, after which attributes are fixed
+  [_ctxRequested] = false;
+
+  /**
+   * Native canvas. Throws once it was destroyed by `_detach`, so that calls
+   * fail instead of drawing into unmapped memory.
+   */
+  get [_ptr](): Deno.PointerValue {
+    const ptr = this[_pointer];
+    if (ptr === null) throw new Error("Canvas is no longer usable");
+    return ptr;
+  }
+
+  set [_ptr](ptr: Deno.PointerValue) {
+    this[_pointer] = ptr;
+  }
 
   get _unsafePointer(): Deno.PointerValue {
     return this[_ptr];
   }
 
+  /**
+   * Destroys the native canvas, after which calls on the canvas and its
+   * context throw. Used by `PixelMapping.close` for the canvases drawing
+   * into it.
+   *
+   * @internal
+   */
+  _detach() {
+    const ptr = this[_pointer];
+    if (ptr === null) return;
+    this[_locked]?.unlock();
+    this[_ctx]._flush();
+    // Destroyed along with the canvas
+    this[_ctx]._unsafePointer = null;
+    CANVAS_FINALIZER.unregister(this);
+    sk_canvas_destroy(ptr);
+    this[_pointer] = null;
+  }
+
+  /** Replays buffered context calls, without fixing context attributes. */
+  _flush() {
+    this[_ctx]._flush();
+  }
+
   get width(): number {
     return this[_width];
   }
@@ -86,16 +337,81 @@ export class Canvas {
     return this[_gpu];
   }
 
-  constructor(width: number, height: number, gpu = false) {
+  /** Non-standard: format of the pixels, see `CanvasOptions.colorType`. */
+  get colorType(): ColorType {
+    return CColorType[sk_canvas_get_color_type(this[_ptr])] as ColorType;
+  }
+
+  constructor(
+    width: number,
+    height: number,
+    options: boolean | CanvasOptions = false,
+  ) {
+    if (typeof options === "boolean") options = { gpu: options };
+    const gpu = options.gpu ?? false;
     this[_gpu] = gpu;
-    this[_ptr] = gpu ? sk_canvas_create_gl(width, height) : sk_canvas_create(
+    if (gpu) {
+      this[_ptr] = sk_canvas_create_gl(width, height);
+    } else if (options.colorType !== undefined || options.alpha === false) {
+      this[_ptr] = sk_canvas_create_typed(
+        width,
+        height,
+        options.colorType === undefined ? -1 : CColorType[options.colorType],
+        options.alpha === false ? 1 : 0,
+      );
+    } else {
+      this[_ptr] = sk_canvas_create(width, height);
+    }
+    this[_init](width, height);
+  }
+
+  /**
+   * Non-standard: creates a raster canvas that draws into the given memory
+   * instead of allocating its own, such as a `PixelMapping` shared with
+   * other processes. The pixels are premultiplied (opaque for formats
+   * without alpha), with rows `rowBytes` apart. The canvas can't be
+   * resized.
+   */
+  static fromPixels(
+    width: number,
+    height: number,
+    pixels: Uint8Array | PixelMapping,
+    options: FromPixelsOptions = {},
+  ): Canvas {
+    const colorType = options.colorType === undefined
+      ? -1
+      : CColorType[options.colorType];
+    const rowBytes = options.rowBytes ??
+      width * (colorType < 0 ? 4 : BYTES_PER_PIXEL[colorType]);
+    if (rowBytes * height > pixels.byteLength) {
+      throw new RangeError("Pixel buffer is too small");
+    }
+    const ptr = pixels instanceof PixelMapping
+      ? pixels._unsafePointer
+      : Deno.UnsafePointer.of(pixels);
+    const canvas = Object.create(Canvas.prototype) as Canvas;
+    canvas[_pointer] = null;
+    canvas[_gpu] = false;
+    canvas[_locked] = null;
+    canvas[_pixels] = pixels;
+    canvas[_ctxRequested] = false;
+    canvas[_ptr] = sk_canvas_create_direct(
       width,
       height,
+      colorType,
+      ptr,
+      BigInt(rowBytes),
     );
-    if (this[_ptr] === null) {
+    canvas[_init](width, height);
+    if (pixels instanceof PixelMapping) pixels._attach(canvas);
+    return canvas;
+  }
+
+  [_init](width: number, height: number) {
+    if (this[_pointer] === null) {
       throw new Error("Failed to create canvas");
     }
-    CANVAS_FINALIZER.register(this, this[_ptr]);
+    CANVAS_FINALIZER.register(this, this[_ptr], this);
     this[_width] = width;
     this[_height] = height;
     this[_ctx] = new CanvasRenderingContext2D(
@@ -114,20 +430,98 @@ export class Canvas {
    * It represents different factors for different formats.
    */
   save(path: string, format: ImageFormat = "png", quality = 100) {
+    this[_ctx]._flush();
     if (!sk_canvas_save(this[_ptr], cstr(path), CFormat[format], quality)) {
       throw new Error("Failed to save canvas");
     }
   }
 
+  /**
+   * Non-standard: like `save`, but writes to an open file descriptor (such
+   * as 1 for stdout), which is left open.
+   */
+  saveToFd(fd: number, format: ImageFormat = "png", quality = 100) {
+    this[_ctx]._flush();
+    if (!sk_canvas_save_fd(this[_ptr], fd, CFormat[format], quality)) {
+      throw new Error("Failed to save canvas");
+    }
+  }
+
+  /**
+   * Non-standard: encodes the canvas on a background thread and streams the
+   * encoded bytes as they are produced, e.g. into an HTTP response:
+   *
+   * ```ts
+   * return new Response(canvas.encodeStream("png"));
+   * ```
+   *
+   * The current content is encoded, drawing afterwards doesn't affect it.
+   * The encoder gets ahead of the reader by at most a few chunks, so no
+   * full copy of the encoded image is kept in memory.
+   */
+  encodeStream(
+    format: ImageFormat = "png",
+    quality = 100,
+  ): ReadableStream<Uint8Array> {
+    this[_ctx]._flush();
+    const ptr = sk_canvas_encode_stream(this[_ptr], CFormat[format], quality);
+    if (ptr === null) {
+      throw new Error("Failed to encode canvas");
+    }
+    // The native stream can only be destroyed once no wait is in flight
+    let waiting: Promise<number> | null = null;
+    let closed = false;
+    const token = {};
+    const destroy = () => {
+      ENCODE_STREAM_FINALIZER.unregister(token);
+      sk_encode_stream_destroy(ptr);
+    };
+    const stream = new ReadableStream<Uint8Array>({
+      async pull(controller) {
+        waiting = sk_encode_stream_wait(ptr);
+        const status = await waiting;
+        waiting = null;
+        if (closed) return;
+        if (status === 1) {
+          const chunk = new Uint8Array(ENCODE_CHUNK_SIZE);
+          const size = sk_encode_stream_read(ptr, chunk, chunk.length);
+          controller.enqueue(chunk.subarray(0, size));
+          return;
+        }
+        closed = true;
+        destroy();
+        if (status < 0) controller.error(new Error("Failed to encode canvas"));
+        else controller.close();
+      },
+      async cancel() {
+        if (closed) return;
+        closed = true;
+        await waiting;
+        destroy();
+      },
+    });
+    ENCODE_STREAM_FINALIZER.register(stream, ptr, token);
+    return stream;
+  }
+
   /**
    * Encode the canvas image into a buffer in specified format
-   * and quality.
+   * and quality, or with more encoder settings:
+   *
+   * ```ts
+   * canvas.encode("png", { compressionLevel: 1, filters: ["sub"] });
+   * canvas.encode("webp", { lossless: true, effort: 0 });
+   * canvas.encode("jpeg", { quality: 90, chromaSubsampling: "4:4:4" });
+   * ```
    */
-  encode(format: ImageFormat = "png", quality = 100): Uint8Array {
-    const bufptr = sk_canvas_encode_image(
+  encode(
+    format: ImageFormat = "png",
+    quality: number | EncodeOptions = 100,
+  ): Uint8Array {
+    this[_ctx]._flush();
+    const bufptr = sk_canvas_encode_image_ex(
       this[_ptr],
-      CFormat[format],
-      quality,
+      encodeOptions(format, quality),
       OUT_SIZE_PTR,
       OUT_DATA_PTR,
     );
@@ -143,6 +537,114 @@ export class Canvas {
     return buffer;
   }
 
+  /**
+   * Non-standard: like `encode`, but encodes on a background thread instead
+   * of blocking the event loop. The content at the time of the call is
+   * encoded, the canvas can be drawn on while the promise is pending.
+   */
+  async encodeAsync(
+    format: ImageFormat = "png",
+    quality: number | EncodeOptions = 100,
+  ): Promise<Uint8Array> {
+    this[_ctx]._flush();
+    const job = sk_canvas_encode_image_async(
+      this[_ptr],
+      encodeOptions(format, quality),
+    );
+    if (job === null) {
+      throw new Error("Failed to encode canvas");
+    }
+    await sk_encode_job_wait(job);
+    // The job is freed here, so the shared out buffers are used right away
+    const bufptr = sk_encode_job_finish(job, OUT_SIZE_PTR, OUT_DATA_PTR);
+    if (bufptr === null) {
+      throw new Error("Failed to encode canvas");
+    }
+
+    const size = OUT_SIZE[0];
+    const ptr = Deno.UnsafePointer.create(OUT_DATA[0]);
+    const buffer = new Uint8Array(getBuffer(bufptr, 0, size));
+    SK_DATA_FINALIZER.register(buffer, ptr);
+    return buffer;
+  }
+
+  /**
+   * Non-standard: gives direct access to the pixels of a raster canvas,
+   * without copying or converting them like `getImageData` does. They are
+   * in the canvas' own format, usually premultiplied BGRA or RGBA depending
+   * on the platform, see `colorType` and `alphaType`.
+   *
+   * ```ts
+   * const pixels = canvas.lockPixels();
+   * try {
+   *   invert(pixels.data, pixels.rowBytes);
+   * } finally {
+   *   pixels.unlock();
+   * }
+   * ```
+   *
+   * Only one lock can be held at a time, and the canvas can't be resized
+   * while locked. Use "read" if the pixels are not written, which avoids
+   * invalidating cached encodes. Context calls made while locked are
+   * buffered and may only reach the pixels on unlock. Snapshots taken while
+   * locked (e.g. by `encode` or `drawImage`) copy the pixels, so the locked
+   * pixels stay those of the canvas.
+   */
+  lockPixels(mode: "read" | "readwrite" = "readwrite"): LockedPixels {
+    if (this[_locked] !== null) {
+      throw new Error("Canvas pixels are already locked");
+    }
+    this[_ctx]._flush();
+    const write = mode === "readwrite" ? 1 : 0;
+    const out = new Int32Array(5);
+    const ptr = sk_canvas_lock_pixels(this[_ptr], write, out);
+    if (ptr === null) {
+      throw new Error("Only raster canvases can be locked");
+    }
+    const [width, height, rowBytes, colorType, alphaType] = out;
+    const locked: LockedPixels = {
+      data: getBuffer(ptr, 0, rowBytes * height),
+      width,
+      height,
+      rowBytes,
+      colorType: CColorType[colorType] as ColorType,
+      alphaType: CAlphaType[alphaType] as AlphaType,
+      unlock: () => {
+        if (this[_locked] !== locked) return;
+        this[_locked] = null;
+        // Detached where supported, so the view can't outlive the surface
+        // it points into
+        try {
+          (locked.data.buffer as ArrayBuffer & {
+            transfer?(length: number): ArrayBuffer;
+          }).transfer?.(0);
+        } catch (_) {
+          // not detachable
+        }
+        this[_ctx]._flush();
+        sk_canvas_unlock_pixels(this[_ptr], write);
+      },
+    };
+    this[_locked] = locked;
+    return locked;
+  }
+
+  /**
+   * Non-standard: counters of the cache of encoded images. `encode` and
+   * `toDataURL` keep the last few images they encoded, and return them
+   * again without encoding as long as nothing was drawn on the canvas.
+   */
+  get encodeCacheStats(): EncodeCacheStats {
+    const out = new BigUint64Array(4);
+    sk_canvas_encode_cache_get_stats(this[_ptr], out);
+    return {
+      hits: Number(out[0]),
+      misses: Number(out[1]),
+      entries: Number(out[2]),
+      bytes: Number(out[3]),
+    };
+  }
+
   /**
    * Creates a data url from the canvas data
    */
@@ -151,6 +653,18 @@ export class Canvas {
     return `data:image/${format};base64,${encodeBase64(buffer)}`;
   }
 
+  /**
+   * Non-standard: `toDataURL` encoding on a background thread, see
+   * `encodeAsync`.
+   */
+  async toDataURLAsync(
+    format: ImageFormat = "png",
+    quality = 100,
+  ): Promise<string> {
+    const buffer = await this.encodeAsync(format, quality);
+    return `data:image/${format};base64,${encodeBase64(buffer)}`;
+  }
+
   /**
    * Read pixels from the canvas into a buffer.
    */
@@ -165,6 +679,7 @@ export class Canvas {
     width = width ?? this[_width];
     height = height ?? this[_height];
     const pixels = into ?? new Uint8Array(width * height * 4);
+    this[_ctx]._flush();
     sk_canvas_read_pixels(
       this[_ptr],
       x,
@@ -180,10 +695,23 @@ export class Canvas {
   /**
    * Returns the Rendering Context of the canvas
    */
-  getContext(type: "2d"): CanvasRenderingContext2D;
-  getContext(type: string): CanvasRenderingContext2D | null {
+  getContext(
+    type: "2d",
+    settings?: CanvasRenderingContext2DSettings,
+  ): CanvasRenderingContext2D;
+  getContext(
+    type: string,
+    settings?: CanvasRenderingContext2DSettings,
+  ): CanvasRenderingContext2D | null {
     switch (type) {
       case "2d": {
+        if (!this[_ctxRequested]) {
+          this[_ctxRequested] = true;
+          if (settings?.alpha === false && this[_pixels] === null) {
+            this[_ctx]._flush();
+            if (sk_canvas_set_opaque(this[_ptr])) this.#replaceContext();
+          }
+        }
         return this[_ctx];
       }
       default:
@@ -191,22 +719,116 @@ export class Canvas {
     }
   }
 
+  /**
+   * Non-standard: whether `encode` and `toDataURL` keep the images they
+   * encode, see `encodeCacheStats`. Turn it off to measure or test the
+   * encoders themselves. Defaults to `true`.
+   */
+  static get encodeCacheEnabled(): boolean {
+    return sk_encode_cache_get_enabled() !== 0;
+  }
+
+  static set encodeCacheEnabled(enabled: boolean) {
+    sk_encode_cache_set_enabled(enabled ? 1 : 0);
+  }
+
+  /**
+   * Non-standard: number of threads used to encode PNGs, 0 (the default)
+   * for one per core. Large images are split into strips of rows which are
+   * compressed concurrently. Set it to 1 to always use Skia's encoder.
+   * Applies to `encode`, `save`, `saveToFd` and `encodeStream`.
+   */
+  static get pngEncoderThreads(): number {
+    return sk_png_get_threads();
+  }
+
+  static set pngEncoderThreads(threads: number) {
+    sk_png_set_threads(threads);
+  }
+
+  /**
+   * Non-standard: renders a recorded picture into an image file without
+   * allocating a canvas for the whole image. Horizontal strips are rendered
+   * one at a time and streamed to the encoder, so memory use stays at about
+   * one strip, which allows images far larger than would fit in memory.
+   *
+   * ```ts
+   * const recorder = new PictureRecorder(4000, 4000);
+   * drawMap(recorder.getContext("2d"));
+   * Canvas.renderToFile(recorder.finish(), "map.png", {
+   *   width: 40000,
+   *   height: 40000,
+   * });
+   * ```
+   */
+  static renderToFile(
+    picture: Picture,
+    path: string,
+    options: RenderToFileOptions = {},
+  ) {
+    if (
+      !sk_canvas_render_to_file(
+        picture._unsafePointer,
+        cstr(path),
+        options.width ?? picture.width,
+        options.height ?? picture.height,
+        CFormat[options.format ?? "png"],
+        options.quality ?? 100,
+        options.stripHeight ?? 256,
+      )
+    ) {
+      throw new Error("Failed to render to file");
+    }
+  }
+
+  /**
+   * Non-standard: draws a recorded picture scaled to the whole canvas,
+   * rasterizing tiles of it concurrently on several threads. Much faster
+   * than `drawPicture` for very large canvases. The context state (such as
+   * its transform, clip or global alpha) does not apply.
+   *
+   * GPU backed canvases draw the picture in one go.
+   */
+  drawPictureTiled(picture: Picture, options: TiledDrawOptions = {}) {
+    this[_ctx]._flush();
+    sk_canvas_draw_picture_tiled(
+      this[_ptr],
+      picture._unsafePointer,
+      options.tileSize ?? 512,
+      options.threads ?? 0,
+    );
+  }
+
   /**
    * Resizes the Canvas to the specified dimensions
    */
   resize(width: number, height: number): void {
     if (this[_width] === width && this[_height] === height) return;
+    if (this[_locked] !== null) {
+      throw new Error("Cannot resize a canvas while its pixels are locked");
+    }
+    if (this[_pixels] !== null) {
+      throw new Error("Cannot resize a canvas drawing into given pixels");
+    }
+    this[_ctx]._flush();
     sk_canvas_set_size(this[_ptr], width, height);
     this[_width] = width;
     this[_height] = height;
-    const ctxPtr = sk_canvas_get_context(this[_ptr]);
-    // In case the context is still being used, we'll just update its pointer
-    this[_ctx]._unsafePointer = ctxPtr;
-    this[_ctx] = new CanvasRenderingContext2D(this, ctxPtr);
+    this.#replaceContext();
+  }
+
+  /**
+   * Points the context at the new native context after the surface was
+   * replaced. The same object is kept, as users may hold on to it and its
+   * command buffer must be the one the canvas flushes.
+   */
+  #replaceContext() {
+    this[_ctx]._unsafePointer = sk_canvas_get_context(this[_ptr]);
   }
 
   /** Only for GPU backed: Flushes all draw calls, call before swap */
   flush() {
+    this[_ctx]._flush();
     if (this[_gpu]) sk_canvas_flush(this[_ptr]);
   }
 
@@ -226,7 +848,7 @@ export class Canvas {
 export function createCanvas(
   width: number,
   height: number,
-  gpu?: boolean,
+  options?: boolean | CanvasOptions,
 ): Canvas {
-  return new Canvas(width, height, gpu);
+  return new Canvas(width, height, options);
 }
@@ -0,0 +1,293 @@
+import ffi from "./ffi.ts";
+
+const { sk_context_execute } = ffi;
+
+/**
+ * Opcodes replayed by `sk_context_execute`, keep in sync with `ContextOp`
+ * in native/include/context2d.hpp.
+ */
+export enum Op {
+  ClearRect,
+  FillRect,
+  StrokeRect,
+  FillText,
+  StrokeText,
+  SetLineWidth,
+  SetLineCap,
+  SetLineJoin,
+  SetMiterLimit,
+  SetLineDash,
+  SetLineDashOffset,
+  SetFont,
+  SetTextAlign,
+  SetTextBaseline,
+  SetTextDirection,
+  SetLetterSpacing,
+  SetWordSpacing,
+  SetFillStyle,
+  SetStrokeStyle,
+  SetShadowBlur,
+  SetShadowColor,
+  SetShadowOffsetX,
+  SetShadowOffsetY,
+  BeginPath,
+  ClosePath,
+  MoveTo,
+  LineTo,
+  BezierCurveTo,
+  QuadraticCurveTo,
+  Arc,
+  ArcTo,
+  Ellipse,
+  Rect,
+  RoundRect,
+  Fill,
+  Stroke,
+  Clip,
+  Rotate,
+  Scale,
+  Translate,
+  Transform,
+  SetTransform,
+  ResetTransform,
+  SetGlobalAlpha,
+  SetGlobalCompositeOperation,
+  SetImageSmoothingEnabled,
+  SetImageSmoothingQuality,
+  Save,
+  Restore,
+}
+
+/** Size of the command buffer in 4-byte words (64 KiB). */
+const CAPACITY = 16 * 1024;
+
+const ENCODER = new TextEncoder();
+
+/**
+ * Records 2D context calls into a shared buffer which is replayed by
+ * `sk_context_execute` in a single FFI call.
+ *
+ * Without a context pointer the buffer only records: flushed commands are
+ * kept, and `take` returns them as one stream that can be replayed later,
+ * e.g. by a `RenderPool`.
+ *
+ * Each command is a u32 opcode followed by its arguments as f32. Commands
+ * taking a string store it inline after the arguments: a u32 byte length,
+ * the UTF-8 bytes and a NUL terminator, padded to a multiple of 4 bytes.
+ *
+ * The buffer is flushed when it fills up, and must be flushed by the owner
+ * before any call that reads native state or draws outside of the buffer.
+ */
+export class CommandBuffer {
+  #u8 = new Uint8Array(CAPACITY * 4);
+  #u32 = new Uint32Array(this.#u8.buffer);
+  #f32 = new Float32Array(this.#u8.buffer);
+  #length = 0;
+  #recorded: Uint8Array[] = [];
+
+  constructor(public ptr: Deno.PointerValue = null) {}
+
+  /** Replays all recorded commands on the native context. */
+  flush() {
+    if (this.#length === 0) return;
+    if (this.ptr === null) {
+      this.#recorded.push(this.#u8.slice(0, this.#length * 4));
+    } else {
+      sk_context_execute(this.ptr, this.#u8, this.#length * 4);
+    }
+    this.#length = 0;
+  }
+
+  /** Returns everything recorded without a context pointer and resets. */
+  take(): Uint8Array {
+    this.flush();
+    const chunks = this.#recorded;
+    this.#recorded = [];
+    if (chunks.length === 1) return chunks[0];
+    const out = new Uint8Array(chunks.reduce((n, c) => n + c.length, 0));
+    let offset = 0;
+    for (const chunk of chunks) {
+      out.set(chunk, offset);
+      offset += chunk.length;
+    }
+    return out;
+  }
+
+  /** Drops all recorded commands without replaying them. */
+  discard() {
+    this.#length = 0;
+  }
+
+  #reserve(words: number): boolean {
+    if (this.#length + words > CAPACITY) {
+      this.flush();
+      if (words > CAPACITY) return false;
+    }
+    return true;
+  }
+
+  #string(str: string) {
+    const start = (this.#length + 1) * 4;
+    const { written } = ENCODER.encodeInto(str, this.#u8.subarray(start));
+    this.#u8[start + written] = 0;
+    this.#u32[this.#length] = written;
+    this.#length += 1 + ((written + 4) >> 2);
+  }
+
+  push0(op: Op) {
+    this.#reserve(1);
+    this.#u32[this.#length++] = op;
+  }
+
+  push1(op: Op, a: number) {
+    this.#reserve(2);
+    const i = this.#length;
+    this.#u32[i] = op;
+    this.#f32[i + 1] = a;
+    this.#length = i + 2;
+  }
+
+  push2(op: Op, a: number, b: number) {
+    this.#reserve(3);
+    const i = this.#length;
+    this.#u32[i] = op;
+    this.#f32[i + 1] = a;
+    this.#f32[i + 2] = b;
+    this.#length = i + 3;
+  }
+
+  push4(op: Op, a: number, b: number, c: number, d: number) {
+    this.#reserve(5);
+    const i = this.#length;
+    this.#u32[i] = op;
+    this.#f32[i + 1] = a;
+    this.#f32[i + 2] = b;
+    this.#f32[i + 3] = c;
+    this.#f32[i + 4] = d;
+    this.#length = i + 5;
+  }
+
+  push5(op: Op, a: number, b: number, c: number, d: number, e: number) {
+    this.#reserve(6);
+    const i = this.#length;
+    this.#u32[i] = op;
+    this.#f32[i + 1] = a;
+    this.#f32[i + 2] = b;
+    this.#f32[i + 3] = c;
+    this.#f32[i + 4] = d;
+    this.#f32[i + 5] = e;
+    this.#length = i + 6;
+  }
+
+  push6(
+    op: Op,
+    a: number,
+    b: number,
+    c: number,
+    d: number,
+    e: number,
+    f: number,
+  ) {
+    this.#reserve(7);
+    const i = this.#length;
+    this.#u32[i] = op;
+    this.#f32[i + 1] = a;
+    this.#f32[i + 2] = b;
+    this.#f32[i + 3] = c;
+    this.#f32[i + 4] = d;
+    this.#f32[i + 5] = e;
+    this.#f32[i + 6] = f;
+    this.#length = i + 7;
+  }
+
+  push8(
+    op: Op,
+    a: number,
+    b: number,
+    c: number,
+    d: number,
+    e: number,
+    f: number,
+    g: number,
+    h: number,
+  ) {
+    this.#reserve(9);
+    const i = this.#length;
+    this.#u32[i] = op;
+    this.#f32[i + 1] = a;
+    this.#f32[i + 2] = b;
+    this.#f32[i + 3] = c;
+    this.#f32[i + 4] = d;
+    this.#f32[i + 5] = e;
+    this.#f32[i + 6] = f;
+    this.#f32[i + 7] = g;
+    this.#f32[i + 8] = h;
+    this.#length = i + 9;
+  }
+
+  /**
+   * Records a command with a single string argument. Returns false if the
+   * string does not fit in the buffer, in which case the caller should make
+   * the call directly.
+   */
+  pushString(op: Op, str: string): boolean {
+    if (!this.#reserve(3 + ((str.length * 3) >> 2))) return false;
+    this.#u32[this.#length++] = op;
+    this.#string(str);
+    return true;
+  }
+
+  /** Records a fillText/strokeText command, see `pushString`. */
+  pushText(
+    op: Op,
+    text: string,
+    x: number,
+    y: number,
+    maxWidth: number,
+  ): boolean {
+    if (!this.#reserve(6 + ((text.length * 3) >> 2))) return false;
+    const i = this.#length;
+    this.#u32[i] = op;
+    this.#f32[i + 1] = x;
+    this.#f32[i + 2] = y;
+    this.#f32[i + 3] = maxWidth;
+    this.#length = i + 4;
+    this.#string(text);
+    return true;
+  }
+
+  /** Records a font change, see `pushString`. */
+  pushFont(
+    size: number,
+    family: string,
+    weight: number,
+    style: number,
+    variant: number,
+    stretch: number,
+  ): boolean {
+    if (!this.#reserve(8 + ((family.length * 3) >> 2))) return false;
+    const i = this.#length;
+    this.#u32[i] = Op.SetFont;
+    this.#f32[i + 1] = size;
+    this.#f32[i + 2] = weight;
+    this.#f32[i + 3] = style;
+    this.#f32[i + 4] = variant;
+    this.#f32[i + 5] = stretch;
+    this.#length = i + 6;
+    this.#string(family);
+    return true;
+  }
+
+  /** Records a setLineDash command. */
+  pushLineDash(segments: number[]): boolean {
+    if (!this.#reserve(2 + segments.length)) return false;
+    const i = this.#length;
+    this.#u32[i] = Op.SetLineDash;
+    this.#u32[i + 1] = segments.length;
+    for (let j = 0; j < segments.length; j++) {
+      this.#f32[i + 2 + j] = segments[j];
+    }
+    this.#length = i + 2 + segments.length;
+    return true;
+  }
+}
@@ -1,4 +1,5 @@
 import { Canvas } from "./canvas.ts";
+import { CommandBuffer, Op } from "./commands.ts";
 import { DOMMatrix } from "./dommatrix.ts";
 import ffi, { cstr } from "./ffi.ts";
 import { FilterType, parseFilterString } from "./filter.ts";
@@ -11,6 +12,7 @@ import {
   type CanvasPatternImage,
   type CanvasPatternRepeat,
 } from "./pattern.ts";
+import type { Picture } from "./recorder.ts";
 
 const {
   sk_context_clear_rect,
@@ -64,7 +66,9 @@ const {
   sk_context_set_text_baseline,
   sk_context_set_text_direction,
   sk_context_draw_image,
+  sk_context_draw_picture,
   sk_context_text,
+  sk_context_measure_text_batch,
   sk_context_get_line_join,
   sk_context_set_line_join,
   sk_context_set_line_dash,
@@ -187,6 +191,16 @@ export type CanvasImageSource = Canvas | Image;
 export type GlobalCompositeOperation = keyof typeof CGlobalCompositeOperation;
 export type ImageSmoothingQuality = keyof typeof CImageSmoothingQuality;
 
+// Color strings already accepted by the native parser, these can be recorded
+// into the command buffer since their result is known up front.
+const VALID_COLORS = new Set<string>();
+const VALID_COLORS_LIMIT = 1024;
+
+function rememberColor(value: string) {
+  if (VALID_COLORS.size >= VALID_COLORS_LIMIT) VALID_COLORS.clear();
+  VALID_COLORS.add(value);
+}
+
 const METRICS = new Float32Array(10);
 const METRICS_PTR = Deno.UnsafePointer.of(METRICS);
 
@@ -205,6 +219,36 @@ export interface TextMetrics {
   ideographicBaseline: number;
 }
 
+/**
+ * Mirrors the checks of `sk_context_set_font`, so that batched font changes
+ * are rejected synchronously just like direct ones.
+ */
+// deno-lint-ignore no-explicit-any
+function isValidFont(font: any): boolean {
+  return font.family !== "" && Number.isFinite(font.size) && font.size >= 0;
+}
+
+/** Reads the `sk_line_metrics` at index `i` of `m`. */
+function readTextMetrics(m: Float32Array, i = 0): TextMetrics {
+  const o = i * 10;
+  return {
+    width: m[o + 4],
+    actualBoundingBoxLeft: m[o + 2],
+    actualBoundingBoxRight: m[o + 3],
+    actualBoundingBoxAscent: m[o],
+    actualBoundingBoxDescent: m[o + 1],
+    fontBoundingBoxAscent: m[o + 5],
+    fontBoundingBoxDescent: m[o + 6],
+    alphabeticBaseline: m[o + 7],
+    emHeightAscent: m[o + 5],
+    emHeightDescent: m[o + 6],
+    ideographicBaseline: m[o + 8],
+    hangingBaseline: m[o + 9],
+  };
+}
+
+const ENCODER = new TextEncoder();
+
 export type Style = string | CanvasGradient | CanvasPattern;
 
 const CFontStretch = {
@@ -244,6 +288,7 @@ export type TextRendering =
 
 const _canvas = Symbol("[[canvas]]");
 const _ptr = Symbol("[[ptr]]");
+const _pointer = Symbol("[[pointer]]");
 const _fillStyle = Symbol("[[fillStyle]]");
 const _strokeStyle = Symbol("[[strokeStyle]]");
 const _shadowColor = Symbol("[[shadowColor]]");
@@ -252,6 +297,7 @@ const _fontStretch = Symbol("[[fontStretch]]");
 const _fontVariantCaps = Symbol("[[fontVariantCaps]]");
 const _lineDash = Symbol("[[lineDash]]");
 const _filter = Symbol("[[filter]]");
+const _commands = Symbol("[[commands]]");
 
 /**
  * @link https://developer.mozilla.org/en-US/docs/Web/API/CanvasRenderingContext2D
@@ -260,7 +306,7 @@ export class CanvasRenderingContext2D {
   /// Internal State
 
   [_canvas]: Canvas;
-  [_ptr]: Deno.PointerValue;
+  [_pointer]: Deno.PointerValue;
 
   [_fillStyle]: Style = "black";
   [_strokeStyle]: Style = "black";
@@ -270,14 +316,35 @@ export class CanvasRenderingContext2D {
   [_fontVariantCaps]: FontVariantCaps = "normal";
   [_lineDash]: number[] = [];
   [_filter] = "none";
+  [_commands]: CommandBuffer | null;
+
+  /**
+   * Native context for drawing calls. Throws once the native context was
+   * released (e.g. by `PictureRecorder.finish`), so that calls on it fail
+   * instead of using freed memory.
+   */
+  get [_ptr](): Deno.PointerValue {
+    const ptr = this[_pointer];
+    if (ptr === null) throw new Error("Context is no longer usable");
+    return ptr;
+  }
 
   /// For FFI interface
   get _unsafePointer(): Deno.PointerValue {
-    return this[_ptr];
+    return this[_pointer];
   }
 
+  /**
+   * Points the context at another native context, resetting its state.
+   * Setting it to null releases the context: calls made afterwards throw.
+   */
   set _unsafePointer(ptr: Deno.PointerValue) {
-    this[_ptr] = ptr;
+    // Commands recorded for the old pointer can no longer be replayed
+    this[_commands]?.discard();
+    if (this[_commands]) this[_commands].ptr = ptr;
+    // Without commands, every drawing call goes through the throwing [_ptr]
+    if (ptr === null) this[_commands] = null;
+    this[_pointer] = ptr;
     this[_fillStyle] = "black";
     this[_strokeStyle] = "black";
     this[_shadowColor] = "black";
@@ -290,30 +357,73 @@ export class CanvasRenderingContext2D {
 
   constructor(canvas: Canvas, ptr: Deno.PointerValue) {
     this[_canvas] = canvas;
-    this[_ptr] = ptr;
-    if (this[_ptr] === null) {
+    this[_pointer] = ptr;
+    if (ptr === null) {
       throw new Error("Failed to create context");
     }
+    this[_commands] = new CommandBuffer(ptr);
+  }
+
+  /**
+   * Replays the drawing commands recorded so far. Called internally before
+   * anything that reads back native state or pixels.
+   */
+  _flush() {
+    this[_commands]?.flush();
+  }
+
+  /**
+   * Non-standard: whether drawing calls are recorded into a command buffer
+   * and sent to Skia in batches (the default), or sent one call at a time.
+   */
+  get batching(): boolean {
+    return this[_commands] !== null;
+  }
+
+  set batching(value: boolean) {
+    if (value === this.batching) return;
+    if (value) {
+      this[_commands] = new CommandBuffer(this[_ptr]);
+    } else {
+      this[_commands]!.flush();
+      this[_commands] = null;
+    }
   }
 
   /// Drawing rectangles
 
   clearRect(x: number, y: number, width: number, height: number) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push4(Op.ClearRect, x, y, width, height);
     sk_context_clear_rect(this[_ptr], x, y, width, height);
   }
 
   fillRect(x: number, y: number, width: number, height: number) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push4(Op.FillRect, x, y, width, height);
     sk_context_fill_rect(this[_ptr], x, y, width, height);
   }
 
   strokeRect(x: number, y: number, width: number, height: number) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push4(Op.StrokeRect, x, y, width, height);
     sk_context_stroke_rect(this[_ptr], x, y, width, height);
   }
 
   /// Drawing text
 
+  /**
+   * Fills the text at the given position.
+   *
+   * Text drawn while commands are batched is shaped when the batch is
+   * flushed, so a failure to shape it is not reported and the text is
+   * skipped. Unbatched calls throw instead.
+   */
   fillText(text: string, x: number, y: number, maxWidth?: number) {
-    const encoded = new TextEncoder().encode(text);
+    const cmd = this[_commands];
+    if (cmd?.pushText(Op.FillText, text, x, y, maxWidth ?? 100_000)) return;
+    this._flush();
+    const encoded = ENCODER.encode(text);
     if (
       !sk_context_text(
         this[_ptr],
@@ -330,8 +440,15 @@ export class CanvasRenderingContext2D {
     }
   }
 
+  /**
+   * Strokes the text at the given position. Like `fillText`, failures are
+   * only reported for unbatched calls.
+   */
   strokeText(text: string, x: number, y: number, maxWidth?: number) {
-    const encoded = new TextEncoder().encode(text);
+    const cmd = this[_commands];
+    if (cmd?.pushText(Op.StrokeText, text, x, y, maxWidth ?? 100_000)) return;
+    this._flush();
+    const encoded = ENCODER.encode(text);
     if (
       !sk_context_text(
         this[_ptr],
@@ -365,7 +482,8 @@ export class CanvasRenderingContext2D {
         hangingBaseline: 0,
       };
     }
-    const encoded = new TextEncoder().encode(text);
+    this._flush();
+    const encoded = ENCODER.encode(text);
     if (
       !sk_context_text(
         this[_ptr],
@@ -380,53 +498,87 @@ export class CanvasRenderingContext2D {
     ) {
       throw new Error("failed to measure text");
     }
-    return {
-      width: METRICS[4],
-      actualBoundingBoxLeft: METRICS[2],
-      actualBoundingBoxRight: METRICS[3],
-      actualBoundingBoxAscent: METRICS[0],
-      actualBoundingBoxDescent: METRICS[1],
-      fontBoundingBoxAscent: METRICS[5],
-      fontBoundingBoxDescent: METRICS[6],
-      alphabeticBaseline: METRICS[7],
-      emHeightAscent: METRICS[5],
-      emHeightDescent: METRICS[6],
-      ideographicBaseline: METRICS[8],
-      hangingBaseline: METRICS[9],
-    };
+    return readTextMetrics(METRICS);
+  }
+
+  /**
+   * Non-standard: measures many strings with the current font in a single
+   * native call. Equivalent to calling `measureText` on each string.
+   */
+  measureTextBatch(strings: string[]): TextMetrics[] {
+    this._flush();
+    const count = strings.length;
+    const offsets = new Uint32Array(count + 1);
+    const bytes = new Uint8Array(
+      strings.reduce((n, s) => n + s.length, 0) * 3,
+    );
+    let length = 0;
+    for (let i = 0; i < count; i++) {
+      const { written } = ENCODER.encodeInto(
+        strings[i],
+        bytes.subarray(length),
+      );
+      length += written;
+      offsets[i + 1] = length;
+    }
+    const metrics = new Float32Array(count * 10);
+    sk_context_measure_text_batch(this[_ptr], bytes, offsets, count, metrics);
+    const result = new Array<TextMetrics>(count);
+    for (let i = 0; i < count; i++) {
+      result[i] = readTextMetrics(metrics, i);
+    }
+    return result;
   }
 
   /// Line styles
 
   get lineWidth(): number {
+    this._flush();
     return sk_context_get_line_width(this[_ptr]);
   }
 
   set lineWidth(value: number) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push1(Op.SetLineWidth, value);
     sk_context_set_line_width(this[_ptr], value);
   }
 
   get lineCap(): LineCap {
+    this._flush();
     return CLineCap[sk_context_get_line_cap(this[_ptr])] as LineCap;
   }
 
   set lineCap(value: LineCap) {
-    sk_context_set_line_cap(this[_ptr], CLineCap[value]);
+    const c = CLineCap[value];
+    // Invalid values are ignored
+    if (typeof c !== "number") return;
+    const cmd = this[_commands];
+    if (cmd) return cmd.push1(Op.SetLineCap, c);
+    sk_context_set_line_cap(this[_ptr], c);
   }
 
   get lineJoin(): LineJoin {
+    this._flush();
     return CLineJoin[sk_context_get_line_join(this[_ptr])] as LineJoin;
   }
 
   set lineJoin(value: LineJoin) {
-    sk_context_set_line_join(this[_ptr], CLineJoin[value]);
+    const c = CLineJoin[value];
+    // Invalid values are ignored
+    if (typeof c !== "number") return;
+    const cmd = this[_commands];
+    if (cmd) return cmd.push1(Op.SetLineJoin, c);
+    sk_context_set_line_join(this[_ptr], c);
   }
 
   get miterLimit(): number {
+    this._flush();
     return sk_context_get_miter_limit(this[_ptr]);
   }
 
   set miterLimit(value: number) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push1(Op.SetMiterLimit, value);
     sk_context_set_miter_limit(this[_ptr], value);
   }
 
@@ -436,14 +588,19 @@ export class CanvasRenderingContext2D {
 
   setLineDash(value: number[]) {
     this[_lineDash] = value;
+    if (this[_commands]?.pushLineDash(value)) return;
+    this._flush();
     sk_context_set_line_dash(this[_ptr], new Float32Array(value), value.length);
   }
 
   get lineDashOffset(): number {
+    this._flush();
     return sk_context_get_line_dash_offset(this[_ptr]);
   }
 
   set lineDashOffset(value: number) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push1(Op.SetLineDashOffset, Number(value));
     sk_context_set_line_dash_offset(this[_ptr], Number(value));
   }
 
@@ -452,6 +609,21 @@ export class CanvasRenderingContext2D {
   set font(value: string) {
     const font = parseFont(value);
     if (font) {
+      if (!isValidFont(font)) return;
+      if (
+        this[_commands]?.pushFont(
+          font.size,
+          font.family,
+          font.weight,
+          font.style,
+          font.variant,
+          font.stretch,
+        )
+      ) {
+        this[_font] = value;
+        return;
+      }
+      this._flush();
       if (
         sk_context_set_font(
           this[_ptr],
@@ -475,53 +647,73 @@ export class CanvasRenderingContext2D {
   }
 
   get textAlign(): TextAlign {
+    this._flush();
     return CTextAlign[sk_context_get_text_align(this[_ptr])] as TextAlign;
   }
 
   set textAlign(value: TextAlign) {
-    sk_context_set_text_align(this[_ptr], CTextAlign[value]);
+    const c = CTextAlign[value];
+    // Invalid values are ignored
+    if (typeof c !== "number") return;
+    const cmd = this[_commands];
+    if (cmd) return cmd.push1(Op.SetTextAlign, c);
+    sk_context_set_text_align(this[_ptr], c);
   }
 
   get textBaseline(): TextBaseline {
+    this._flush();
     return CTextBaseline[
       sk_context_get_text_baseline(this[_ptr])
     ] as TextBaseline;
   }
 
   set textBaseline(value: TextBaseline) {
-    sk_context_set_text_baseline(this[_ptr], CTextBaseline[value]);
+    const c = CTextBaseline[value];
+    // Invalid values are ignored
+    if (typeof c !== "number") return;
+    const cmd = this[_commands];
+    if (cmd) return cmd.push1(Op.SetTextBaseline, c);
+    sk_context_set_text_baseline(this[_ptr], c);
   }
 
   get direction(): TextDirection {
+    this._flush();
     return CTextDirection[
       sk_context_get_text_direction(this[_ptr])
     ] as TextDirection;
   }
 
   set direction(value: TextDirection) {
-    sk_context_set_text_direction(this[_ptr], CTextDirection[value]);
+    const c = CTextDirection[value];
+    // Invalid values are ignored
+    if (typeof c !== "number") return;
+    const cmd = this[_commands];
+    if (cmd) return cmd.push1(Op.SetTextDirection, c);
+    sk_context_set_text_direction(this[_ptr], c);
   }
 
   get letterSpacing(): string {
+    this._flush();
     return sk_context_get_letter_spacing(this[_ptr]) + "px";
   }
 
   set letterSpacing(value: number | string) {
-    sk_context_set_letter_spacing(
-      this[_ptr],
-      typeof value === "number" ? value : parseFloat(value),
-    );
+    const spacing = typeof value === "number" ? value : parseFloat(value);
+    const cmd = this[_commands];
+    if (cmd) return cmd.push1(Op.SetLetterSpacing, spacing);
+    sk_context_set_letter_spacing(this[_ptr], spacing);
   }
 
   get wordSpacing(): string {
+    this._flush();
     return sk_context_get_word_spacing(this[_ptr]) + "px";
   }
 
   set wordSpacing(value: number | string) {
-    sk_context_set_word_spacing(
-      this[_ptr],
-      typeof value === "number" ? value : parseFloat(value),
-    );
+    const spacing = typeof value === "number" ? value : parseFloat(value);
+    const cmd = this[_commands];
+    if (cmd) return cmd.push1(Op.SetWordSpacing, spacing);
+    sk_context_set_word_spacing(this[_ptr], spacing);
   }
 
   get fontKerning(): FontKerning {
@@ -544,6 +736,7 @@ export class CanvasRenderingContext2D {
       throw new Error("invalid fontStretch");
     }
     this[_fontStretch] = value;
+    this._flush();
     sk_context_set_font_stretch(this[_ptr], c);
   }
 
@@ -557,6 +750,7 @@ export class CanvasRenderingContext2D {
       throw new Error("invalid fontVariantCaps");
     }
     this[_fontVariantCaps] = value;
+    this._flush();
     sk_context_set_font_variant_caps(this[_ptr], c);
   }
 
@@ -577,9 +771,18 @@ export class CanvasRenderingContext2D {
   }
 
   set fillStyle(value: Style) {
+    if (
+      typeof value === "string" && VALID_COLORS.has(value) &&
+      this[_commands]?.pushString(Op.SetFillStyle, value)
+    ) {
+      this[_fillStyle] = value;
+      return;
+    }
+    this._flush();
     if (typeof value === "string") {
       if (sk_context_set_fill_style(this[_ptr], cstr(value))) {
         this[_fillStyle] = value;
+        rememberColor(value);
       }
     } else if (
       typeof value === "object" && value !== null &&
@@ -603,9 +806,18 @@ export class CanvasRenderingContext2D {
   }
 
   set strokeStyle(value: Style) {
+    if (
+      typeof value === "string" && VALID_COLORS.has(value) &&
+      this[_commands]?.pushString(Op.SetStrokeStyle, value)
+    ) {
+      this[_strokeStyle] = value;
+      return;
+    }
+    this._flush();
     if (typeof value === "string") {
       if (sk_context_set_stroke_style(this[_ptr], cstr(value))) {
         this[_strokeStyle] = value;
+        rememberColor(value);
       }
     } else if (
       typeof value === "object" && value !== null &&
@@ -666,10 +878,13 @@ export class CanvasRenderingContext2D {
   /// Shadows
 
   get shadowBlur(): number {
+    this._flush();
     return sk_context_get_shadow_blur(this[_ptr]);
   }
 
   set shadowBlur(value: number) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push1(Op.SetShadowBlur, value);
     sk_context_set_shadow_blur(this[_ptr], value);
   }
 
@@ -678,42 +893,65 @@ export class CanvasRenderingContext2D {
   }
 
   set shadowColor(value: string) {
+    if (
+      VALID_COLORS.has(value) &&
+      this[_commands]?.pushString(Op.SetShadowColor, value)
+    ) {
+      this[_shadowColor] = value;
+      return;
+    }
+    this._flush();
     if (sk_context_set_shadow_color(this[_ptr], cstr(value))) {
       this[_shadowColor] = value;
+      rememberColor(value);
     }
   }
 
   get shadowOffsetX(): number {
+    this._flush();
     return sk_context_get_shadow_offset_x(this[_ptr]);
   }
 
   set shadowOffsetX(value: number) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push1(Op.SetShadowOffsetX, value);
     sk_context_set_shadow_offset_x(this[_ptr], value);
   }
 
   get shadowOffsetY(): number {
+    this._flush();
     return sk_context_get_shadow_offset_y(this[_ptr]);
   }
 
   set shadowOffsetY(value: number) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push1(Op.SetShadowOffsetY, value);
     sk_context_set_shadow_offset_y(this[_ptr], value);
   }
 
   /// Paths
 
   beginPath() {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push0(Op.BeginPath);
     sk_context_begin_path(this[_ptr]);
   }
 
   closePath() {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push0(Op.ClosePath);
     sk_context_close_path(this[_ptr]);
   }
 
   moveTo(x: number, y: number) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push2(Op.MoveTo, x, y);
     sk_context_move_to(this[_ptr], x, y);
   }
 
   lineTo(x: number, y: number) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push2(Op.LineTo, x, y);
     sk_context_line_to(this[_ptr], x, y);
   }
 
@@ -725,10 +963,14 @@ export class CanvasRenderingContext2D {
     x: number,
     y: number,
   ) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push6(Op.BezierCurveTo, cp1x, cp1y, cp2x, cp2y, x, y);
     sk_context_bezier_curve_to(this[_ptr], cp1x, cp1y, cp2x, cp2y, x, y);
   }
 
   quadraticCurveTo(cpx: number, cpy: number, x: number, y: number) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push4(Op.QuadraticCurveTo, cpx, cpy, x, y);
     sk_context_quadratic_curve_to(this[_ptr], cpx, cpy, x, y);
   }
 
@@ -740,6 +982,19 @@ export class CanvasRenderingContext2D {
     endAngle: number,
     anticlockwise: boolean,
   ) {
+    const cmd = this[_commands];
+    if (cmd) {
+      cmd.push6(
+        Op.Arc,
+        x,
+        y,
+        radius,
+        startAngle,
+        endAngle,
+        anticlockwise ? 1 : 0,
+      );
+      return;
+    }
     sk_context_arc(
       this[_ptr],
       x,
@@ -758,6 +1013,8 @@ export class CanvasRenderingContext2D {
     y2: number,
     radius: number,
   ) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push5(Op.ArcTo, x1, y1, x2, y2, radius);
     sk_context_arc_to(this[_ptr], x1, y1, x2, y2, radius);
   }
 
@@ -771,6 +1028,21 @@ export class CanvasRenderingContext2D {
     endAngle: number,
     anticlockwise: boolean,
   ) {
+    const cmd = this[_commands];
+    if (cmd) {
+      cmd.push8(
+        Op.Ellipse,
+        x,
+        y,
+        radiusX,
+        radiusY,
+        rotation,
+        startAngle,
+        endAngle,
+        anticlockwise ? 1 : 0,
+      );
+      return;
+    }
     sk_context_ellipse(
       this[_ptr],
       x,
@@ -785,6 +1057,8 @@ export class CanvasRenderingContext2D {
   }
 
   rect(x: number, y: number, width: number, height: number) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push4(Op.Rect, x, y, width, height);
     sk_context_rect(this[_ptr], x, y, width, height);
   }
 
@@ -795,14 +1069,12 @@ export class CanvasRenderingContext2D {
     height: number,
     r: RoundRectRadii,
   ) {
-    sk_context_round_rect(
-      this[_ptr],
-      x,
-      y,
-      width,
-      height,
-      ...roundRectRadiiArg(r),
-    );
+    const [tl, tr, br, bl] = roundRectRadiiArg(r);
+    const cmd = this[_commands];
+    if (cmd) {
+      return cmd.push8(Op.RoundRect, x, y, width, height, tl, tr, br, bl);
+    }
+    sk_context_round_rect(this[_ptr], x, y, width, height, tl, tr, br, bl);
   }
 
   /// Drawing paths
@@ -817,10 +1089,22 @@ export class CanvasRenderingContext2D {
         ? path._unsafePointer
         : null;
     const irule = (typeof path === "string" ? path : rule) ?? "nonzero";
+    const cmd = this[_commands];
+    if (cmd && pathptr === null) {
+      cmd.push1(Op.Fill, irule === "evenodd" ? 1 : 0);
+      return;
+    }
+    this._flush();
     sk_context_fill(this[_ptr], pathptr, irule === "evenodd" ? 1 : 0);
   }
 
   stroke(path?: Path2D) {
+    const cmd = this[_commands];
+    if (cmd && !path) {
+      cmd.push0(Op.Stroke);
+      return;
+    }
+    this._flush();
     sk_context_stroke(
       this[_ptr],
       path ? path._unsafePointer : null,
@@ -848,6 +1132,12 @@ export class CanvasRenderingContext2D {
       : null;
     const fillRuleStr = typeof path === "string" ? path : fillRule;
     const ifillRule = fillRuleStr === "evenodd" ? 1 : 0;
+    const cmd = this[_commands];
+    if (cmd && pathptr === null) {
+      cmd.push1(Op.Clip, ifillRule);
+      return;
+    }
+    this._flush();
     sk_context_clip(this[_ptr], pathptr, ifillRule);
   }
 
@@ -874,6 +1164,7 @@ export class CanvasRenderingContext2D {
     const ifillRule = (typeof y === "string" ? y : fillRule) === "evenodd"
       ? 1
       : 0;
+    this._flush();
     return sk_context_is_point_in_path(
       this[_ptr],
       typeof path === "number" ? path : x,
@@ -900,6 +1191,7 @@ export class CanvasRenderingContext2D {
     const pathptr = typeof path === "object" && path !== null
       ? path._unsafePointer
       : null;
+    this._flush();
     return sk_context_is_point_in_stroke(
       this[_ptr],
       typeof path === "number" ? path : x,
@@ -912,19 +1204,26 @@ export class CanvasRenderingContext2D {
 
   getTransform(): DOMMatrix {
     const f32 = new Float32Array(6);
+    this._flush();
     sk_context_get_transform(this[_ptr], f32);
     return new DOMMatrix(f32[0], f32[1], f32[2], f32[3], f32[4], f32[5]);
   }
 
   rotate(angle: number) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push1(Op.Rotate, angle);
     sk_context_rotate(this[_ptr], angle);
   }
 
   scale(x: number, y: number) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push2(Op.Scale, x, y);
     sk_context_scale(this[_ptr], x, y);
   }
 
   translate(x: number, y: number) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push2(Op.Translate, x, y);
     sk_context_translate(this[_ptr], x, y);
   }
 
@@ -936,6 +1235,8 @@ export class CanvasRenderingContext2D {
     e: number,
     f: number,
   ) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push6(Op.Transform, a, b, c, d, e, f);
     sk_context_transform(this[_ptr], a, b, c, d, e, f);
   }
 
@@ -956,28 +1257,35 @@ export class CanvasRenderingContext2D {
     e?: number,
     f?: number,
   ) {
-    if (typeof a === "number") {
-      sk_context_set_transform(this[_ptr], a, b!, c!, d!, e!, f!);
-    } else {
-      sk_context_set_transform(this[_ptr], a.a, a.b, a.c, a.d, a.e, a.f);
+    if (typeof a !== "number") {
+      return this.setTransform(a.a, a.b, a.c, a.d, a.e, a.f);
     }
+    const cmd = this[_commands];
+    if (cmd) return cmd.push6(Op.SetTransform, a, b!, c!, d!, e!, f!);
+    sk_context_set_transform(this[_ptr], a, b!, c!, d!, e!, f!);
   }
 
   resetTransform() {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push0(Op.ResetTransform);
     sk_context_reset_transform(this[_ptr]);
   }
 
   /// Compositing
 
   get globalAlpha(): number {
+    this._flush();
     return sk_context_get_global_alpha(this[_ptr]);
   }
 
   set globalAlpha(value: number) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push1(Op.SetGlobalAlpha, value);
     sk_context_set_global_alpha(this[_ptr], value);
   }
 
   get globalCompositeOperation(): GlobalCompositeOperation {
+    this._flush();
     const op = sk_context_get_global_composite_operation(this[_ptr]);
     return Object.entries(CGlobalCompositeOperation).find((e) =>
       e[1] === op
@@ -985,10 +1293,11 @@ export class CanvasRenderingContext2D {
   }
 
   set globalCompositeOperation(value: GlobalCompositeOperation) {
-    sk_context_set_global_composite_operation(
-      this[_ptr],
-      CGlobalCompositeOperation[value],
-    );
+    const op = CGlobalCompositeOperation[value];
+    if (typeof op !== "number") return;
+    const cmd = this[_commands];
+    if (cmd) return cmd.push1(Op.SetGlobalCompositeOperation, op);
+    sk_context_set_global_composite_operation(this[_ptr], op);
   }
 
   /// Drawing images
@@ -1034,6 +1343,8 @@ export class CanvasRenderingContext2D {
     const sy = asy === undefined ? 0 : ady;
     const sw = asw === undefined ? image.width : adw ?? image.width;
     const sh = ash === undefined ? image.height : adh ?? image.height;
+    if (image instanceof Canvas) image._flush();
+    this._flush();
     sk_context_draw_image(
       this[_ptr],
       image instanceof Canvas ? image._unsafePointer : null,
@@ -1049,6 +1360,29 @@ export class CanvasRenderingContext2D {
     );
   }
 
+  /**
+   * Non-standard: replays a picture recorded with a `PictureRecorder`,
+   * scaled from its bounds to the destination rectangle. Being vector
+   * data, it stays sharp at any scale.
+   */
+  drawPicture(
+    picture: Picture,
+    dx = 0,
+    dy = 0,
+    dw = picture.width,
+    dh = picture.height,
+  ) {
+    this._flush();
+    sk_context_draw_picture(
+      this[_ptr],
+      picture._unsafePointer,
+      dx,
+      dy,
+      dw,
+      dh,
+    );
+  }
+
   /// Pixel manipulation
 
   createImageData(sw: number, sh: number): ImageData;
@@ -1066,6 +1400,7 @@ export class CanvasRenderingContext2D {
       throw new Error("getImageData is only supported on Canvas");
     }
     const data = new Uint8Array(sw * sh * 4);
+    this._flush();
     this[_canvas].readPixels(sx, sy, sw, sh, data, "srgb");
     return new ImageData(data, sw, sh);
   }
@@ -1079,6 +1414,7 @@ export class CanvasRenderingContext2D {
     dirtyWidth?: number,
     dirtyHeight?: number,
   ) {
+    this._flush();
     if (dirtyX !== undefined) {
       dirtyX = dirtyX ?? 0;
       dirtyY = dirtyY ?? 0;
@@ -1134,32 +1470,41 @@ export class CanvasRenderingContext2D {
   /// Image smoothing
 
   get imageSmoothingEnabled(): boolean {
+    this._flush();
     return sk_context_get_image_smoothing_enabled(this[_ptr]) === 1;
   }
 
   set imageSmoothingEnabled(value: boolean) {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push1(Op.SetImageSmoothingEnabled, value ? 1 : 0);
     sk_context_set_image_smoothing_enabled(this[_ptr], value ? 1 : 0);
   }
 
   get imageSmoothingQuality(): ImageSmoothingQuality {
+    this._flush();
     const quality = sk_context_get_image_smoothing_quality(this[_ptr]);
     return CImageSmoothingQuality[quality] as ImageSmoothingQuality;
   }
 
   set imageSmoothingQuality(value: ImageSmoothingQuality) {
-    sk_context_set_image_smoothing_quality(
-      this[_ptr],
-      CImageSmoothingQuality[value],
-    );
+    const quality = CImageSmoothingQuality[value];
+    if (typeof quality !== "number") return;
+    const cmd = this[_commands];
+    if (cmd) return cmd.push1(Op.SetImageSmoothingQuality, quality);
+    sk_context_set_image_smoothing_quality(this[_ptr], quality);
   }
 
   /// The canvas state
 
   save() {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push0(Op.Save);
     sk_context_save(this[_ptr]);
   }
 
   restore() {
+    const cmd = this[_commands];
+    if (cmd) return cmd.push0(Op.Restore);
     sk_context_restore(this[_ptr]);
   }
 
@@ -1192,6 +1537,7 @@ export class CanvasRenderingContext2D {
   }
 
   set filter(value: string) {
+    this._flush();
     if (value === "none" || value === "") {
       sk_context_filter_reset(this[_ptr]);
       this[_filter] = value;
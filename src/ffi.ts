@@ -445,6 +445,11 @@ const SYMBOLS = {
     result: "i32",
   },
 
+  index_system_fonts: {
+    parameters: ["buffer"],
+    result: "i32",
+  },
+
   fonts_register_path: {
     parameters: ["buffer"],
     result: "i32",
@@ -460,6 +465,11 @@ const SYMBOLS = {
     result: "i32",
   },
 
+  fonts_index_dir: {
+    parameters: ["buffer"],
+    result: "i32",
+  },
+
   fonts_set_alias: {
     parameters: ["buffer", "buffer"],
     result: "void",
@@ -475,6 +485,26 @@ const SYMBOLS = {
     result: "pointer",
   },
 
+  sk_text_cache_set_budget: {
+    parameters: ["usize"],
+    result: "void",
+  },
+
+  sk_text_cache_get_stats: {
+    parameters: ["buffer"],
+    result: "void",
+  },
+
+  sk_text_cache_clear: {
+    parameters: [],
+    result: "void",
+  },
+
+  sk_text_set_fast_path: {
+    parameters: ["i32"],
+    result: "void",
+  },
+
   sk_context_text: {
     parameters: [
       "pointer",
@@ -489,6 +519,11 @@ const SYMBOLS = {
     result: "i32",
   },
 
+  sk_context_measure_text_batch: {
+    parameters: ["pointer", "buffer", "buffer", "i32", "buffer"],
+    result: "void",
+  },
+
   sk_context_get_line_join: {
     parameters: ["pointer"],
     result: "i32",
@@ -824,11 +859,133 @@ const SYMBOLS = {
     result: "pointer",
   },
 
+  sk_canvas_create_typed: {
+    parameters: ["i32", "i32", "i32", "i32"],
+    result: "pointer",
+  },
+
+  sk_canvas_set_opaque: {
+    parameters: ["pointer"],
+    result: "i32",
+  },
+
+  sk_canvas_get_color_type: {
+    parameters: ["pointer"],
+    result: "i32",
+  },
+
+  sk_canvas_create_direct: {
+    parameters: ["i32", "i32", "i32", "pointer", "usize"],
+    result: "pointer",
+  },
+
+  sk_file_map: {
+    parameters: ["buffer", "u64", "i32"],
+    result: "pointer",
+  },
+
+  sk_file_unmap: {
+    parameters: ["pointer", "u64"],
+    result: "void",
+  },
+
   sk_canvas_flush: {
     parameters: ["pointer"],
     result: "void",
   },
 
+  sk_canvas_save_fd: {
+    parameters: ["pointer", "i32", "i32", "i32"],
+    result: "i32",
+  },
+
+  sk_canvas_encode_stream: {
+    parameters: ["pointer", "i32", "i32"],
+    result: "pointer",
+  },
+
+  sk_encode_stream_wait: {
+    parameters: ["pointer"],
+    result: "i32",
+    nonblocking: true,
+  },
+
+  sk_encode_stream_read: {
+    parameters: ["pointer", "buffer", "i32"],
+    result: "i32",
+  },
+
+  sk_encode_stream_destroy: {
+    parameters: ["pointer"],
+    result: "void",
+  },
+
+  sk_canvas_encode_image_ex: {
+    parameters: ["pointer", "buffer", "buffer", "buffer"],
+    result: "pointer",
+  },
+
+  sk_canvas_encode_cache_get_stats: {
+    parameters: ["pointer", "buffer"],
+    result: "void",
+  },
+
+  sk_encode_cache_set_enabled: {
+    parameters: ["i32"],
+    result: "void",
+  },
+
+  sk_encode_cache_get_enabled: {
+    parameters: [],
+    result: "i32",
+  },
+
+  sk_canvas_lock_pixels: {
+    parameters: ["pointer", "i32", "buffer"],
+    result: "pointer",
+  },
+
+  sk_canvas_unlock_pixels: {
+    parameters: ["pointer", "i32"],
+    result: "void",
+  },
+
+  sk_canvas_encode_image_async: {
+    parameters: ["pointer", "buffer"],
+    result: "pointer",
+  },
+
+  sk_encode_job_wait: {
+    parameters: ["pointer"],
+    result: "i32",
+    nonblocking: true,
+  },
+
+  sk_encode_job_finish: {
+    parameters: ["pointer", "buffer", "buffer"],
+    result: "pointer",
+  },
+
+  sk_png_set_threads: {
+    parameters: ["i32"],
+    result: "void",
+  },
+
+  sk_png_get_threads: {
+    parameters: [],
+    result: "i32",
+  },
+
+  sk_canvas_render_to_file: {
+    parameters: ["pointer", "buffer", "i32", "i32", "i32", "i32", "i32"],
+    result: "i32",
+  },
+
+  sk_canvas_draw_picture_tiled: {
+    parameters: ["pointer", "pointer", "i32", "i32"],
+    result: "void",
+  },
+
   sk_canvas_set_size: {
     parameters: ["pointer", "i32", "i32"],
     result: "void",
@@ -885,6 +1042,97 @@ const SYMBOLS = {
     parameters: ["pointer"],
     result: "void",
   },
+
+  sk_context_execute: {
+    parameters: ["pointer", "buffer", "usize"],
+    result: "void",
+  },
+
+  sk_debug_allocation_count: {
+    parameters: [],
+    result: "i64",
+  },
+
+  sk_render_pool_create: {
+    parameters: ["i32"],
+    result: "pointer",
+  },
+
+  sk_render_pool_destroy: {
+    parameters: ["pointer"],
+    result: "void",
+  },
+
+  sk_render_pool_thread_count: {
+    parameters: ["pointer"],
+    result: "i32",
+  },
+
+  sk_render_pool_submit: {
+    parameters: ["pointer", "buffer", "usize", "i32", "i32", "i32", "i32"],
+    result: "u32",
+  },
+
+  sk_render_pool_submit_picture: {
+    parameters: ["pointer", "pointer", "i32", "i32", "i32", "i32"],
+    result: "u32",
+  },
+
+  sk_render_pool_wait: {
+    parameters: ["pointer"],
+    result: "i32",
+    nonblocking: true,
+  },
+
+  sk_render_pool_poll: {
+    parameters: ["pointer", "buffer", "buffer", "buffer", "buffer"],
+    result: "i32",
+  },
+
+  sk_recorder_create: {
+    parameters: ["f32", "f32"],
+    result: "pointer",
+  },
+
+  sk_recorder_destroy: {
+    parameters: ["pointer"],
+    result: "void",
+  },
+
+  sk_recorder_get_context: {
+    parameters: ["pointer"],
+    result: "pointer",
+  },
+
+  sk_recorder_finish: {
+    parameters: ["pointer"],
+    result: "pointer",
+  },
+
+  sk_picture_destroy: {
+    parameters: ["pointer"],
+    result: "void",
+  },
+
+  sk_picture_get_bounds: {
+    parameters: ["pointer", "buffer"],
+    result: "void",
+  },
+
+  sk_picture_serialize: {
+    parameters: ["pointer", "buffer", "buffer"],
+    result: "pointer",
+  },
+
+  sk_picture_deserialize: {
+    parameters: ["buffer", "usize"],
+    result: "pointer",
+  },
+
+  sk_context_draw_picture: {
+    parameters: ["pointer", "pointer", "f32", "f32", "f32", "f32"],
+    result: "void",
+  },
 } as const;
 
 const LOCAL_BUILD = Deno.env.get("DENO_SKIA_LOCAL") === "1";
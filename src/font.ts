@@ -2,19 +2,52 @@ import ffi, { cstr, readCstr } from "./ffi.ts";
 
 const {
   fonts_register_dir,
+  fonts_index_dir,
   fonts_register_memory,
   fonts_register_path,
   fonts_set_alias,
   setup_font_collection,
   load_system_fonts,
+  index_system_fonts,
   fonts_count,
   fonts_family,
+  sk_text_cache_set_budget,
+  sk_text_cache_get_stats,
+  sk_text_cache_clear,
 } = ffi;
 
+/** Counters of the shaped text cache, see `Fonts.textCacheStats`. */
+export interface TextCacheStats {
+  hits: number;
+  misses: number;
+  entries: number;
+  /** Approximate memory used by the cached entries. */
+  bytes: number;
+  budget: number;
+}
+
+/** Default location of the system font index, see `Fonts.systemFontCount`. */
+function fontIndexPath(): string {
+  const custom = Deno.env.get("CANVAS_FONT_INDEX_CACHE");
+  if (custom) return custom;
+  const base = Deno.build.os === "windows"
+    ? Deno.env.get("LOCALAPPDATA")
+    : Deno.env.get("XDG_CACHE_HOME") ??
+      (Deno.env.get("HOME") && `${Deno.env.get("HOME")}/.cache`);
+  return base ? `${base}/skia_canvas/fonts.idx` : "";
+}
+
+function loadSystemFonts(): number {
+  if (Deno.env.get("CANVAS_DISABLE_SYSTEM_FONTS") == "1") return 0;
+  if (Deno.env.get("CANVAS_LAZY_SYSTEM_FONTS") != "1") {
+    return load_system_fonts();
+  }
+  const path = fontIndexPath();
+  return index_system_fonts(path ? cstr(path) : null);
+}
+
 setup_font_collection();
-const SYSTEM_FONTS = Deno.env.get("CANVAS_DISABLE_SYSTEM_FONTS") == "1"
-  ? 0
-  : load_system_fonts();
+const SYSTEM_FONTS = loadSystemFonts();
 
 /**
  * Manage fonts to be used by Skia.
@@ -26,6 +59,14 @@ export class Fonts {
    *
    * If you want to disable loading system fonts, set the
    * `CANVAS_DISABLE_SYSTEM_FONTS` environment variable to `1`.
+   *
+   * Setting `CANVAS_LAZY_SYSTEM_FONTS` to `1` only indexes the family names
+   * of the system fonts at startup, and loads a family the first time it is
+   * used. The index is cached in `CANVAS_FONT_INDEX_CACHE` (by default
+   * `skia_canvas/fonts.idx` in the user cache directory) and rebuilt when
+   * the font directories change. In this mode the count is the number of
+   * indexed names, and system families are only listed in `families` once
+   * they have been used.
    */
   static get systemFontCount(): number {
     return SYSTEM_FONTS;
@@ -57,6 +98,14 @@ export class Fonts {
     return fonts_register_dir(cstr(dir));
   }
 
+  /**
+   * Index the family names of all fonts in a directory, loading a family the
+   * first time it is used. Returns the number of indexed names.
+   */
+  static indexDir(dir: string): number {
+    return fonts_index_dir(cstr(dir));
+  }
+
   /** Register a font either from file or in memory buffer */
   static register(path: string): void;
   static register(data: Uint8Array, alias?: string): void;
@@ -74,4 +123,37 @@ export class Fonts {
   static setAlias(alias: string, family: string) {
     fonts_set_alias(cstr(alias), cstr(family));
   }
+
+  /**
+   * Hit/miss counters and size of the cache of shaped text shared by
+   * fillText, strokeText and measureText.
+   */
+  static get textCacheStats(): TextCacheStats {
+    const out = new BigUint64Array(5);
+    sk_text_cache_get_stats(out);
+    return {
+      hits: Number(out[0]),
+      misses: Number(out[1]),
+      entries: Number(out[2]),
+      bytes: Number(out[3]),
+      budget: Number(out[4]),
+    };
+  }
+
+  /**
+   * Approximate memory budget of the shaped text cache in bytes, 8 MiB by
+   * default. Setting it to 0 disables the cache.
+   */
+  static get textCacheBudget(): number {
+    return Fonts.textCacheStats.budget;
+  }
+
+  static set textCacheBudget(bytes: number) {
+    sk_text_cache_set_budget(bytes);
+  }
+
+  /** Drops all entries of the shaped text cache. */
+  static clearTextCache() {
+    sk_text_cache_clear();
+  }
 }
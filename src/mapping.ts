@@ -0,0 +1,95 @@
+import ffi, { cstr, getBuffer } from "./ffi.ts";
+
+const { sk_file_map, sk_file_unmap } = ffi;
+
+interface Mapped {
+  ptr: Deno.PointerValue;
+  size: number;
+}
+
+const MAPPING_FINALIZER = new FinalizationRegistry((mapped: Mapped) => {
+  sk_file_unmap(mapped.ptr, mapped.size);
+});
+
+/** Options of `PixelMapping`. */
+export interface PixelMappingOptions {
+  /** Creates the file, or grows it to the mapped size, if needed. */
+  create?: boolean;
+}
+
+/**
+ * Non-standard: a file mapped into memory, shared with every process that
+ * maps the same file. Pass it to `Canvas.fromPixels` to draw straight into
+ * the file, e.g. for another process to read rendered frames without any
+ * copy. On Linux, paths in /dev/shm are shared memory that never reaches
+ * the disk.
+ *
+ * ```ts
+ * // Worker process
+ * const frame = new PixelMapping("/dev/shm/frame", 1920 * 1080 * 4, {
+ *   create: true,
+ * });
+ * const canvas = Canvas.fromPixels(1920, 1080, frame);
+ *
+ * // Compositor process
+ * const frame = new PixelMapping("/dev/shm/frame", 1920 * 1080 * 4);
+ * const pixels = frame.data;
+ * ```
+ */
+export class PixelMapping {
+  #mapped: Mapped | null;
+  #data: Uint8Array;
+  // Canvases from `Canvas.fromPixels` drawing into the mapping
+  #canvases: WeakRef<{ _detach(): void }>[] = [];
+
+  constructor(
+    path: string,
+    byteLength: number,
+    options: PixelMappingOptions = {},
+  ) {
+    const create = options.create ? 1 : 0;
+    const ptr = sk_file_map(cstr(path), BigInt(byteLength), create);
+    if (ptr === null) {
+      throw new Error(`Failed to map ${path}`);
+    }
+    this.#mapped = { ptr, size: byteLength };
+    this.#data = getBuffer(ptr, 0, byteLength);
+    MAPPING_FINALIZER.register(this, this.#mapped, this);
+  }
+
+  get _unsafePointer(): Deno.PointerValue {
+    return this.#mapped?.ptr ?? null;
+  }
+
+  get byteLength(): number {
+    return this.#mapped?.size ?? 0;
+  }
+
+  /** The mapped bytes. */
+  get data(): Uint8Array {
+    if (this.#mapped === null) {
+      throw new Error("PixelMapping is closed");
+    }
+    return this.#data;
+  }
+
+  /** @internal Called by `Canvas.fromPixels`, see `close`. */
+  _attach(canvas: { _detach(): void }) {
+    this.#canvases = this.#canvases.filter((ref) => ref.deref() !== undefined);
+    this.#canvases.push(new WeakRef(canvas));
+  }
+
+  /**
+   * Unmaps the file now rather than once garbage collected. Canvases drawing
+   * into it are released first: using them afterwards throws.
+   */
+  close() {
+    if (this.#mapped === null) return;
+    for (const ref of this.#canvases) ref.deref()?._detach();
+    this.#canvases = [];
+    MAPPING_FINALIZER.unregister(this);
+    sk_file_unmap(this.#mapped.ptr, this.#mapped.size);
+    this.#mapped = null;
+    this.#data = new Uint8Array(0);
+  }
+}
@@ -75,12 +75,14 @@ export class PdfRenderingContext2D extends CanvasRenderingContext2D {
 }
 
 const _ptr = Symbol("[[ptr]]");
+const _page = Symbol("[[page]]");
 
 /**
  * Create a new PDF document to draw using Canvas 2D API.
  */
 export class PdfDocument {
   [_ptr]: Deno.PointerValue;
+  [_page]: PdfRenderingContext2D | null = null;
 
   constructor(options: PdfMetadata = {}) {
     this[_ptr] = sk_pdf_new(
@@ -109,6 +111,8 @@ export class PdfDocument {
    * You must not use the context after calling endPage.
    */
   newPage(w: number, h: number, contentRect?: Rect): PdfRenderingContext2D {
+    // Beginning a page ends the current one natively
+    this[_page]?._flush();
     const ptr = sk_pdf_begin_page(
       this[_ptr],
       w,
@@ -120,16 +124,20 @@ export class PdfDocument {
     if (!ptr) {
       throw new Error("Failed to create new page");
     }
-    return new PdfRenderingContext2D(this, ptr, w, h);
+    this[_page] = new PdfRenderingContext2D(this, ptr, w, h);
+    return this[_page];
   }
 
   /** Writes the page into internal stream and destroys  */
   endPage() {
+    this[_page]?._flush();
+    this[_page] = null;
     sk_pdf_end_page(this[_ptr]);
   }
 
   /** Saves PDF to the file and closes the stream. Changes cannot be made to PDF after this. */
   save(path: string) {
+    this[_page]?._flush();
     if (!sk_pdf_write_file(this[_ptr], cstr(path))) {
       throw new Error("Failed to save PDF");
     }
@@ -137,6 +145,7 @@ export class PdfDocument {
 
   /** Encodes the PDF into a buffer and closes the stream. Changes cannot be made to PDF after this. */
   encode(): Uint8Array {
+    this[_page]?._flush();
     const skdata = sk_pdf_get_buffer(this[_ptr], OUT_DATA_PTR, OUT_SIZE_PTR);
     if (!skdata) {
       throw new Error("Failed to encode PDF");
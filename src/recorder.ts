@@ -0,0 +1,149 @@
+import { CanvasRenderingContext2D } from "./context2d.ts";
+import ffi, { getBuffer } from "./ffi.ts";
+
+const {
+  sk_recorder_create,
+  sk_recorder_destroy,
+  sk_recorder_get_context,
+  sk_recorder_finish,
+  sk_picture_destroy,
+  sk_picture_get_bounds,
+  sk_picture_serialize,
+  sk_picture_deserialize,
+  sk_data_free,
+} = ffi;
+
+const RECORDER_FINALIZER = new FinalizationRegistry(
+  (ptr: Deno.PointerValue) => {
+    sk_recorder_destroy(ptr);
+  },
+);
+
+const PICTURE_FINALIZER = new FinalizationRegistry(
+  (ptr: Deno.PointerValue) => {
+    sk_picture_destroy(ptr);
+  },
+);
+
+const SK_DATA_FINALIZER = new FinalizationRegistry(
+  (ptr: Deno.PointerValue) => {
+    sk_data_free(ptr);
+  },
+);
+
+const OUT_BOUNDS = new Float32Array(4);
+const OUT_SIZE = new Uint32Array(1);
+const OUT_SIZE_PTR = new Uint8Array(OUT_SIZE.buffer);
+const OUT_DATA = new BigUint64Array(1);
+const OUT_DATA_PTR = new Uint8Array(OUT_DATA.buffer);
+
+const _ptr = Symbol("[[ptr]]");
+const _ctx = Symbol("[[ctx]]");
+
+/**
+ * An immutable recording of drawing commands, created by a
+ * `PictureRecorder`. It can be replayed onto any canvas, PDF page or SVG
+ * at any size with `drawPicture`, or rendered by a `RenderPool`.
+ */
+export class Picture {
+  [_ptr]: Deno.PointerValue;
+  readonly width: number;
+  readonly height: number;
+
+  /** @internal */
+  constructor(ptr: Deno.PointerValue) {
+    this[_ptr] = ptr;
+    sk_picture_get_bounds(ptr, OUT_BOUNDS);
+    this.width = OUT_BOUNDS[2];
+    this.height = OUT_BOUNDS[3];
+    PICTURE_FINALIZER.register(this, ptr);
+  }
+
+  get _unsafePointer(): Deno.PointerValue {
+    return this[_ptr];
+  }
+
+  /**
+   * Serializes the picture so it can be stored, e.g. in a render cache on
+   * disk, and rendered later with `Picture.deserialize`.
+   *
+   * Fonts are stored as references to the registered or system fonts when
+   * possible, so the same fonts must be available when loading; other
+   * fonts are embedded. Identical images are only stored once. The format
+   * is tied to the machine and Skia build, it is not an interchange format.
+   */
+  serialize(): Uint8Array {
+    const skdata = sk_picture_serialize(this[_ptr], OUT_DATA_PTR, OUT_SIZE_PTR);
+    const buffer = new Uint8Array(
+      getBuffer(Deno.UnsafePointer.create(OUT_DATA[0]), 0, OUT_SIZE[0]),
+    );
+    SK_DATA_FINALIZER.register(buffer, skdata);
+    return buffer;
+  }
+
+  /** Loads a picture from data returned by `serialize`. */
+  static deserialize(data: Uint8Array): Picture {
+    const ptr = sk_picture_deserialize(data, data.length);
+    if (ptr === null) throw new Error("Invalid picture data");
+    return new Picture(ptr);
+  }
+}
+
+export class RecordingContext2D extends CanvasRenderingContext2D {
+  // @ts-expect-error typescript warning
+  declare readonly canvas: PictureRecorder;
+
+  constructor(recorder: PictureRecorder, ptr: Deno.PointerValue) {
+    // deno-lint-ignore no-explicit-any
+    super(recorder as any, ptr);
+  }
+}
+
+/**
+ * Records drawing on a 2D context into a `Picture` instead of pixels, so a
+ * drawing can be made once and output at several sizes and formats without
+ * running the drawing code again.
+ *
+ * ```ts
+ * const recorder = new PictureRecorder(800, 600);
+ * drawChart(recorder.getContext("2d"));
+ * const picture = recorder.finish();
+ * thumbnail.getContext("2d").drawPicture(picture, 0, 0, 200, 150);
+ * ```
+ */
+export class PictureRecorder {
+  [_ptr]: Deno.PointerValue;
+  [_ctx]: RecordingContext2D | null = null;
+
+  constructor(
+    public readonly width: number,
+    public readonly height: number,
+  ) {
+    this[_ptr] = sk_recorder_create(width, height);
+    RECORDER_FINALIZER.register(this, this[_ptr]);
+  }
+
+  getContext(type: "2d"): RecordingContext2D {
+    if (type !== "2d") throw new Error(`Unsupported context type: ${type}`);
+    if (this[_ctx] === null) {
+      const ptr = sk_recorder_get_context(this[_ptr]);
+      if (ptr === null) throw new Error("Recording already finished");
+      this[_ctx] = new RecordingContext2D(this, ptr);
+    }
+    return this[_ctx];
+  }
+
+  /**
+   * Ends the recording and returns the picture. Calls on the context throw
+   * afterwards.
+   */
+  finish(): Picture {
+    this[_ctx]?._flush();
+    const ptr = sk_recorder_finish(this[_ptr]);
+    if (ptr === null) throw new Error("Recording already finished");
+    // The native context was destroyed along with the recording
+    if (this[_ctx]) this[_ctx]._unsafePointer = null;
+    this[_ctx] = null;
+    return new Picture(ptr);
+  }
+}
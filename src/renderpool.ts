@@ -0,0 +1,158 @@
+import ffi, { getBuffer } from "./ffi.ts";
+import { CFormat, type ImageFormat } from "./canvas.ts";
+import type { Picture } from "./recorder.ts";
+
+export { CommandBuffer, Op } from "./commands.ts";
+
+const {
+  sk_render_pool_create,
+  sk_render_pool_destroy,
+  sk_render_pool_thread_count,
+  sk_render_pool_submit,
+  sk_render_pool_submit_picture,
+  sk_render_pool_wait,
+  sk_render_pool_poll,
+  sk_data_free,
+} = ffi;
+
+const OUT_ID = new Uint32Array(1);
+const OUT_SIZE = new Int32Array(1);
+const OUT_BYTES = new BigUint64Array(1);
+const OUT_DATA = new BigUint64Array(1);
+
+const SK_DATA_FINALIZER = new FinalizationRegistry(
+  (ptr: Deno.PointerValue) => {
+    sk_data_free(ptr);
+  },
+);
+
+interface PendingJob {
+  resolve: (data: Uint8Array) => void;
+  reject: (error: Error) => void;
+}
+
+/**
+ * Non-standard: rasterizes and encodes recorded drawings on a pool of native
+ * threads, so that many independent images can be rendered in parallel
+ * while the JS thread keeps recording.
+ *
+ * Drawings are either `Picture`s from a `PictureRecorder`, or command
+ * streams in the format of `CommandBuffer`, recorded with a `CommandBuffer`
+ * created without a context and returned by `take`.
+ *
+ * ```ts
+ * const pool = new RenderPool();
+ * const cmd = new CommandBuffer();
+ * cmd.pushString(Op.SetFillStyle, "red");
+ * cmd.push4(Op.FillRect, 10, 10, 100, 100);
+ * const png = await pool.render(200, 200, cmd.take());
+ * await pool.close();
+ * ```
+ */
+export class RenderPool {
+  #ptr: Deno.PointerValue;
+  #jobs = new Map<number, PendingJob>();
+  #waiting: Promise<void> | null = null;
+  #closed = false;
+
+  /** Creates a pool of `threads` threads, one per core by default. */
+  constructor(threads = 0) {
+    this.#ptr = sk_render_pool_create(threads);
+  }
+
+  /** Number of native threads rendering jobs. */
+  get threads(): number {
+    return sk_render_pool_thread_count(this.#ptr);
+  }
+
+  /**
+   * Queues a drawing to be replayed on a fresh `width` x `height` canvas
+   * and encoded. The commands are copied, so the buffer can be reused.
+   */
+  render(
+    width: number,
+    height: number,
+    commands: Uint8Array,
+    format: ImageFormat = "png",
+    quality = 100,
+  ): Promise<Uint8Array> {
+    if (this.#closed) throw new Error("RenderPool is closed");
+    const id = sk_render_pool_submit(
+      this.#ptr,
+      commands,
+      commands.length,
+      width,
+      height,
+      CFormat[format],
+      quality,
+    );
+    return this.#track(id);
+  }
+
+  /**
+   * Queues a picture to be rendered scaled to `width` x `height` (its own
+   * size by default) and encoded.
+   */
+  renderPicture(
+    picture: Picture,
+    width = picture.width,
+    height = picture.height,
+    format: ImageFormat = "png",
+    quality = 100,
+  ): Promise<Uint8Array> {
+    if (this.#closed) throw new Error("RenderPool is closed");
+    const id = sk_render_pool_submit_picture(
+      this.#ptr,
+      picture._unsafePointer,
+      width,
+      height,
+      CFormat[format],
+      quality,
+    );
+    return this.#track(id);
+  }
+
+  #track(id: number): Promise<Uint8Array> {
+    const promise = new Promise<Uint8Array>((resolve, reject) => {
+      this.#jobs.set(id, { resolve, reject });
+    });
+    this.#waiting ??= this.#drain();
+    return promise;
+  }
+
+  /** Waits for all queued drawings, then stops the threads. */
+  async close() {
+    if (this.#closed) return;
+    this.#closed = true;
+    await this.#waiting;
+    sk_render_pool_destroy(this.#ptr);
+    this.#ptr = null;
+  }
+
+  // Only one wait is in flight at a time, it blocks on a native thread
+  async #drain() {
+    while (this.#jobs.size > 0) {
+      await sk_render_pool_wait(this.#ptr);
+      this.#poll();
+    }
+    this.#waiting = null;
+  }
+
+  #poll() {
+    while (
+      sk_render_pool_poll(this.#ptr, OUT_ID, OUT_SIZE, OUT_BYTES, OUT_DATA)
+    ) {
+      const job = this.#jobs.get(OUT_ID[0])!;
+      this.#jobs.delete(OUT_ID[0]);
+      const data = Deno.UnsafePointer.create(OUT_DATA[0]);
+      if (data === null) {
+        job.reject(new Error("Failed to render"));
+        continue;
+      }
+      const bytes = Deno.UnsafePointer.create(OUT_BYTES[0]);
+      const buffer = new Uint8Array(getBuffer(bytes, 0, OUT_SIZE[0]));
+      SK_DATA_FINALIZER.register(buffer, data);
+      job.resolve(buffer);
+    }
+  }
+}
@@ -33,6 +33,9 @@ export class SvgRenderingContext2D extends CanvasRenderingContext2D {
   constructor(canvas: SvgCanvas, ptr: Deno.PointerValue) {
     // deno-lint-ignore no-explicit-any
     super(canvas as any, ptr);
+    // Every getContext call returns another context drawing into the same
+    // SVG, so calls are sent right away to keep them in order
+    this.batching = false;
   }
 }
 
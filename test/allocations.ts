@@ -0,0 +1,35 @@
+import { Canvas } from "../mod.ts";
+import ffi from "../src/ffi.ts";
+import { assertEquals } from "./deps.ts";
+
+const { sk_debug_allocation_count } = ffi;
+
+// Only builds with -DCANVAS_COUNT_ALLOCATIONS=ON count allocations, see the
+// test-allocations task.
+const counting = Number(sk_debug_allocation_count()) >= 0;
+
+Deno.test({
+  name: "steady-state drawing does not allocate",
+  ignore: !counting,
+  fn() {
+    const canvas = new Canvas(200, 200);
+    const ctx = canvas.getContext("2d");
+    ctx.batching = false;
+    ctx.fillStyle = "red";
+    ctx.strokeStyle = "blue";
+    ctx.lineWidth = 4;
+
+    const draw = () => {
+      for (let i = 0; i < 100; i++) {
+        ctx.fillRect(i, i, 10, 10);
+        ctx.strokeRect(i, i, 10, 10);
+      }
+    };
+
+    // First draw builds the cached paints.
+    draw();
+    const before = Number(sk_debug_allocation_count());
+    draw();
+    assertEquals(Number(sk_debug_allocation_count()) - before, 0);
+  },
+});
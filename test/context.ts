@@ -0,0 +1,73 @@
+import { Canvas, SvgCanvas } from "../mod.ts";
+import { assertEquals } from "./deps.ts";
+
+function pixel(canvas: Canvas, x: number, y: number) {
+  return Array.from(canvas.readPixels(x, y, 1, 1));
+}
+
+Deno.test("a context held across a resize keeps drawing", () => {
+  const canvas = new Canvas(100, 100);
+  const ctx = canvas.getContext("2d");
+  ctx.fillStyle = "red";
+  ctx.fillRect(0, 0, 10, 10);
+
+  canvas.width = 300;
+  assertEquals(canvas.getContext("2d"), ctx);
+  // The state is reset along with the pixels
+  assertEquals(ctx.fillStyle, "black");
+  ctx.fillStyle = "blue";
+  ctx.fillRect(200, 0, 10, 10);
+  canvas.getContext("2d").fillStyle = "lime";
+  canvas.getContext("2d").fillRect(210, 0, 10, 10);
+  assertEquals(pixel(canvas, 5, 5), [0, 0, 0, 0]);
+  assertEquals(pixel(canvas, 205, 5), [0, 0, 255, 255]);
+  assertEquals(pixel(canvas, 215, 5), [0, 255, 0, 255]);
+
+  canvas.resize(250, 50);
+  ctx.fillRect(0, 0, 10, 10);
+  assertEquals(pixel(canvas, 5, 5), [0, 0, 0, 255]);
+});
+
+Deno.test("a rejected font leaves the font unchanged", () => {
+  const ctx = new Canvas(10, 10).getContext("2d");
+  ctx.font = "12px serif";
+  ctx.font = ".px serif";
+  assertEquals(ctx.font, "12px serif");
+  ctx.fillText("batched", 0, 10);
+  ctx.font = "..px sans-serif";
+  assertEquals(ctx.font, "12px serif");
+});
+
+Deno.test("invalid enum values are ignored", () => {
+  const ctx = new Canvas(10, 10).getContext("2d");
+  ctx.lineCap = "round";
+  ctx.textAlign = "center";
+  ctx.globalCompositeOperation = "multiply";
+  // deno-lint-ignore no-explicit-any
+  const invalid = "bogus" as any;
+  ctx.lineCap = invalid;
+  ctx.lineJoin = invalid;
+  ctx.textAlign = invalid;
+  ctx.textBaseline = invalid;
+  ctx.direction = invalid;
+  ctx.globalCompositeOperation = invalid;
+  ctx.imageSmoothingQuality = invalid;
+  assertEquals(ctx.lineCap, "round");
+  assertEquals(ctx.textAlign, "center");
+  assertEquals(ctx.globalCompositeOperation, "multiply");
+});
+
+Deno.test("calls on several SVG contexts keep their order", () => {
+  const svg = new SvgCanvas(100, 100);
+  const a = svg.getContext();
+  const b = svg.getContext();
+  a.fillStyle = "#ff0000";
+  a.fillRect(0, 0, 10, 10);
+  b.fillStyle = "#00ff00";
+  b.fillRect(10, 0, 10, 10);
+  a.fillRect(20, 0, 10, 10);
+  svg.complete();
+  const fills = [...svg.toString().matchAll(/fill="(#[0-9A-F]+)"/gi)]
+    .map((m) => m[1].toUpperCase());
+  assertEquals(fills, ["#FF0000", "#00FF00", "#FF0000"]);
+});
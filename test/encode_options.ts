@@ -0,0 +1,112 @@
+import { Canvas, Image } from "../mod.ts";
+import { assertEquals } from "./deps.ts";
+
+function canvas() {
+  const canvas = new Canvas(800, 600);
+  const ctx = canvas.getContext("2d");
+  // Opaque, so lossless round trips are exact
+  ctx.fillStyle = "white";
+  ctx.fillRect(0, 0, 800, 600);
+  ctx.drawImage(Image.loadSync("testdata/chart.png"), 0, 0);
+  return canvas;
+}
+
+function decode(bytes: Uint8Array) {
+  const decoded = new Canvas(800, 600);
+  decoded.getContext("2d").drawImage(new Image(bytes), 0, 0);
+  return decoded.readPixels();
+}
+
+Deno.test("encode without options matches the defaults", () => {
+  const c = canvas();
+  // Both calls pass the same settings, so they would share a cache entry
+  Canvas.encodeCacheEnabled = false;
+  try {
+    for (const format of ["png", "jpeg", "webp"] as const) {
+      assertEquals(c.encode(format, { quality: 80 }), c.encode(format, 80));
+    }
+    assertEquals(c.encode("png", { compressionLevel: 6 }), c.encode("png"));
+    assertEquals(c.encodeCacheStats.hits, 0);
+  } finally {
+    Canvas.encodeCacheEnabled = true;
+  }
+});
+
+Deno.test("PNG compression settings are lossless", () => {
+  const c = canvas();
+  const pixels = decode(c.encode("png"));
+  const fast = c.encode("png", { compressionLevel: 0, filters: ["none"] });
+  const small = c.encode("png", { compressionLevel: 9 });
+  assertEquals(fast.length > small.length, true);
+  assertEquals(decode(fast), pixels);
+  assertEquals(decode(small), pixels);
+  assertEquals(decode(c.encode("png", { filters: ["sub", "up"] })), pixels);
+});
+
+Deno.test("WebP and JPEG settings", () => {
+  const c = canvas();
+  const lossless = c.encode("webp", { quality: 50, lossless: true });
+  assertEquals(decode(lossless), decode(c.encode("png")));
+  const lossy = c.encode("webp", { quality: 50, lossless: false });
+  assertEquals(lossy.length < lossless.length, true);
+  assertEquals(
+    c.encode("webp", { lossless: true, effort: 0 }).length > 0,
+    true,
+  );
+
+  const subsampled = c.encode("jpeg", { quality: 90 });
+  const full = c.encode("jpeg", { quality: 90, chromaSubsampling: "4:4:4" });
+  assertEquals(full.length > subsampled.length, true);
+});
+
+Deno.test("encoding an unchanged canvas again is cached", () => {
+  const c = canvas();
+  const ctx = c.getContext("2d");
+  const png = c.encode("png");
+  c.toDataURL("png");
+  c.encode("jpeg", 90);
+  assertEquals(c.encode("png"), png);
+  assertEquals(c.encodeCacheStats.hits, 2);
+  assertEquals(c.encodeCacheStats.misses, 2);
+  assertEquals(c.encodeCacheStats.entries, 2);
+
+  // Reading doesn't change the content, drawing does
+  c.readPixels();
+  c.encode("png");
+  assertEquals(c.encodeCacheStats.hits, 3);
+  ctx.fillRect(0, 0, 10, 10);
+  c.encode("png");
+  assertEquals(c.encodeCacheStats.misses, 3);
+  assertEquals(c.encodeCacheStats.entries, 1);
+
+  // The cached bytes can't be changed through a returned buffer
+  const first = c.encode("png");
+  first.fill(0);
+  assertEquals(c.encode("png")[1], 80);
+});
+
+Deno.test("the encode cache depends on the PNG thread count", () => {
+  const c = canvas();
+  const threads = Canvas.pngEncoderThreads;
+  try {
+    Canvas.pngEncoderThreads = 1;
+    c.encode("png");
+    Canvas.pngEncoderThreads = 4;
+    c.encode("png");
+    assertEquals(c.encodeCacheStats.hits, 0);
+    assertEquals(c.encodeCacheStats.entries, 2);
+    c.encode("png");
+    assertEquals(c.encodeCacheStats.hits, 1);
+  } finally {
+    Canvas.pngEncoderThreads = threads;
+  }
+
+  Canvas.encodeCacheEnabled = false;
+  try {
+    c.encode("png");
+    assertEquals(c.encodeCacheStats.hits, 1);
+    assertEquals(c.encodeCacheStats.misses, 3);
+  } finally {
+    Canvas.encodeCacheEnabled = true;
+  }
+});
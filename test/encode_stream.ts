@@ -0,0 +1,57 @@
+import { Canvas, Image } from "../mod.ts";
+import { assertEquals } from "./deps.ts";
+
+function canvas() {
+  const canvas = new Canvas(640, 480);
+  const ctx = canvas.getContext("2d");
+  // Enough detail for the PNG to span several chunks
+  for (let i = 0; i < 2000; i++) {
+    ctx.fillStyle = `hsl(${i % 360}, 80%, ${30 + (i % 40)}%)`;
+    ctx.fillRect((i * 37) % 640, (i * 53) % 480, 3 + (i % 17), 3 + (i % 13));
+  }
+  return canvas;
+}
+
+Deno.test("encodeStream produces the same bytes as encode", async () => {
+  const c = canvas();
+  for (const format of ["png", "jpeg", "webp"] as const) {
+    const streamed = new Uint8Array(
+      await new Response(c.encodeStream(format, 90)).arrayBuffer(),
+    );
+    assertEquals(streamed, c.encode(format, 90));
+  }
+});
+
+Deno.test("encodeStream can be cancelled early", async () => {
+  const reader = canvas().encodeStream("png").getReader();
+  const { value } = await reader.read();
+  assertEquals(value!.length > 0, true);
+  await reader.cancel();
+});
+
+Deno.test("encodeAsync matches encode", async () => {
+  const c = canvas();
+  for (const format of ["png", "jpeg", "webp"] as const) {
+    assertEquals(await c.encodeAsync(format, 90), c.encode(format, 90));
+  }
+  assertEquals(await c.toDataURLAsync(), c.toDataURL());
+});
+
+Deno.test("encodeAsync encodes the content when called", async () => {
+  const c = new Canvas(2000, 2000);
+  const ctx = c.getContext("2d");
+  ctx.fillStyle = "red";
+  ctx.fillRect(0, 0, 2000, 2000);
+  const expected = c.readPixels();
+  const pending = c.encodeAsync("png");
+  // Drawing while the encoder runs copies the pixels instead of changing
+  // the snapshot being encoded
+  ctx.fillStyle = "blue";
+  ctx.fillRect(0, 0, 2000, 2000);
+  const drawn = c.readPixels();
+
+  const decoded = new Canvas(2000, 2000);
+  decoded.getContext("2d").drawImage(new Image(await pending), 0, 0);
+  assertEquals(decoded.readPixels(), expected);
+  assertEquals(c.readPixels(), drawn);
+});
@@ -0,0 +1,38 @@
+import { Fonts } from "../mod.ts";
+import { assertEquals } from "./deps.ts";
+
+// A WOFF header followed by bytes that read as a table directory with a name
+// table for "Bogus", if the file were mistaken for a plain sfnt.
+function fakeWoff() {
+  const data = new Uint8Array(56);
+  const view = new DataView(data.buffer);
+  data.set(new TextEncoder().encode("wOFF"), 0);
+  view.setUint32(4, 0x00010000);
+  data.set(new TextEncoder().encode("name"), 12);
+  view.setUint32(20, 28);
+  view.setUint32(24, 28);
+  // name table: one Windows English family name record
+  view.setUint16(30, 1);
+  view.setUint16(32, 18);
+  view.setUint16(34, 3);
+  view.setUint16(36, 1);
+  view.setUint16(38, 0x409);
+  view.setUint16(40, 1);
+  view.setUint16(42, 10);
+  view.setUint16(44, 0);
+  for (const [i, c] of [..."Bogus"].entries()) {
+    view.setUint16(46 + i * 2, c.charCodeAt(0));
+  }
+  return data;
+}
+
+Deno.test("indexing doesn't read WOFF files as sfnt", () => {
+  const dir = Deno.makeTempDirSync();
+  try {
+    Deno.writeFileSync(`${dir}/fake.woff`, fakeWoff());
+    // Falls back to loading the typeface, which fails for the fake file
+    assertEquals(Fonts.indexDir(dir), 0);
+  } finally {
+    Deno.removeSync(dir, { recursive: true });
+  }
+});
@@ -0,0 +1,66 @@
+import { Canvas, type ColorType, Image } from "../mod.ts";
+import { assertEquals } from "./deps.ts";
+
+function draw(canvas: Canvas) {
+  const ctx = canvas.getContext("2d");
+  ctx.fillStyle = "#ff0000";
+  ctx.fillRect(0, 0, 50, 40);
+  ctx.fillStyle = "#0000ff";
+  ctx.fillRect(50, 0, 50, 40);
+}
+
+function pixel(canvas: Canvas, x: number, y: number) {
+  return Array.from(canvas.readPixels(x, y, 1, 1));
+}
+
+Deno.test("canvases in each format", () => {
+  const formats: [ColorType, number, number[]][] = [
+    ["rgba8888", 4, [255, 0, 0, 255]],
+    ["bgra8888", 4, [255, 0, 0, 255]],
+    // Only coverage is kept
+    ["alpha8", 1, [0, 0, 0, 255]],
+    ["rgb565", 2, [255, 0, 0, 255]],
+    ["rgbaF16", 8, [255, 0, 0, 255]],
+    ["rgb888x", 4, [255, 0, 0, 255]],
+  ];
+  for (const [colorType, bytes, red] of formats) {
+    const canvas = new Canvas(100, 40, { colorType });
+    assertEquals(canvas.colorType, colorType);
+    draw(canvas);
+    assertEquals(pixel(canvas, 10, 10), red);
+
+    const pixels = canvas.lockPixels("read");
+    assertEquals(pixels.rowBytes, 100 * bytes);
+    assertEquals(pixels.colorType, colorType);
+    pixels.unlock();
+
+    // Resizing keeps the format
+    canvas.resize(20, 20);
+    assertEquals(canvas.colorType, colorType);
+  }
+});
+
+Deno.test("formats without alpha are opaque", () => {
+  for (const colorType of ["rgb565", "rgb888x"] as const) {
+    const canvas = new Canvas(10, 10, { colorType });
+    const pixels = canvas.lockPixels("read");
+    assertEquals(pixels.alphaType, "opaque");
+    pixels.unlock();
+    // Cleared pixels are opaque black
+    canvas.getContext("2d").clearRect(0, 0, 10, 10);
+    assertEquals(pixel(canvas, 5, 5), [0, 0, 0, 255]);
+  }
+});
+
+Deno.test("canvases in each format encode", () => {
+  for (const colorType of ["rgb565", "rgbaF16", "rgb888x"] as const) {
+    const canvas = new Canvas(100, 40, { colorType });
+    draw(canvas);
+    const decoded = new Canvas(100, 40);
+    decoded.getContext("2d").drawImage(new Image(canvas.encode("png")), 0, 0);
+    assertEquals(decoded.readPixels(), canvas.readPixels());
+  }
+  const mask = new Canvas(100, 40, { colorType: "alpha8" });
+  draw(mask);
+  assertEquals(mask.encode("png").length > 0, true);
+});
@@ -0,0 +1,100 @@
+import { Canvas, Image, PixelMapping } from "../mod.ts";
+import { assertEquals, assertNotEquals, assertThrows } from "./deps.ts";
+
+export function drawFrame(canvas: Canvas) {
+  const ctx = canvas.getContext("2d");
+  ctx.fillStyle = "#336699";
+  ctx.fillRect(0, 0, canvas.width, canvas.height);
+  ctx.fillStyle = "orange";
+  ctx.beginPath();
+  ctx.arc(80, 60, 40, 0, Math.PI * 2);
+  ctx.fill();
+}
+
+Deno.test("canvases draw into the given pixels", () => {
+  // Rows padded to 700 bytes
+  const pixels = new Uint8Array(700 * 120);
+  const canvas = Canvas.fromPixels(160, 120, pixels, {
+    colorType: "rgba8888",
+    rowBytes: 700,
+  });
+  drawFrame(canvas);
+  canvas.flush();
+  const row = pixels.subarray(700 * 119, 700 * 119 + 640);
+  assertEquals(Array.from(row.subarray(0, 4)), [0x33, 0x66, 0x99, 255]);
+  assertEquals(
+    Array.from(pixels.subarray(700 * 60 + 80 * 4, 700 * 60 + 80 * 4 + 4)),
+    [255, 165, 0, 255],
+  );
+  // Padding is left alone
+  assertEquals(pixels[700 * 119 + 640], 0);
+
+  const copy = new Canvas(160, 120);
+  drawFrame(copy);
+  assertEquals(canvas.readPixels(), copy.readPixels());
+  assertThrows(() => canvas.resize(10, 10));
+  assertThrows(() => Canvas.fromPixels(160, 120, new Uint8Array(100)));
+});
+
+Deno.test("encoding sees writes to the given pixels", () => {
+  const pixels = new Uint8Array(160 * 120 * 4);
+  const canvas = Canvas.fromPixels(160, 120, pixels, {
+    colorType: "rgba8888",
+  });
+  drawFrame(canvas);
+  const png = canvas.encode("png");
+  pixels.fill(255);
+  const changed = canvas.encode("png");
+  assertNotEquals(changed, png);
+  const decoded = new Canvas(160, 120);
+  decoded.getContext("2d").drawImage(new Image(changed), 0, 0);
+  const first = Array.from(decoded.readPixels().subarray(0, 4));
+  assertEquals(first, [255, 255, 255, 255]);
+  assertEquals(canvas.encodeCacheStats.hits, 0);
+});
+
+Deno.test("another process reads frames through a mapped file", async () => {
+  const path = Deno.makeTempFileSync();
+  const [width, height] = [160, 120];
+  const child = new Deno.Command(Deno.execPath(), {
+    args: [
+      "run",
+      "-A",
+      "--unstable-ffi",
+      new URL("./mapping_child.ts", import.meta.url).href,
+      path,
+      `${width}`,
+      `${height}`,
+    ],
+  });
+  const { success } = await child.output();
+  assertEquals(success, true);
+
+  const mapping = new PixelMapping(path, width * height * 4);
+  const expected = new Uint8Array(width * height * 4);
+  const local = Canvas.fromPixels(width, height, expected, {
+    colorType: "rgba8888",
+  });
+  drawFrame(local);
+  local.flush();
+  assertEquals(mapping.data, expected);
+  mapping.close();
+  Deno.removeSync(path);
+});
+
+Deno.test("closing a mapping releases the canvases drawing into it", () => {
+  const path = Deno.makeTempFileSync();
+  const mapping = new PixelMapping(path, 160 * 120 * 4, { create: true });
+  const canvas = Canvas.fromPixels(160, 120, mapping);
+  const ctx = canvas.getContext("2d");
+  drawFrame(canvas);
+  canvas.lockPixels("read");
+  mapping.close();
+
+  assertThrows(() => canvas.readPixels());
+  assertThrows(() => canvas.encode("png"));
+  assertThrows(() => ctx.fillRect(0, 0, 10, 10));
+  const other = new Canvas(10, 10).getContext("2d");
+  assertThrows(() => other.drawImage(canvas, 0, 0));
+  Deno.removeSync(path);
+});
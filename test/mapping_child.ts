@@ -0,0 +1,11 @@
+// Renders into a mapped file for test/mapping.ts, from another process
+import { Canvas, PixelMapping } from "../mod.ts";
+import { drawFrame } from "./mapping.ts";
+
+const [path, width, height] = Deno.args;
+const mapping = new PixelMapping(path, +width * +height * 4, { create: true });
+const canvas = Canvas.fromPixels(+width, +height, mapping, {
+  colorType: "rgba8888",
+});
+drawFrame(canvas);
+canvas.flush();
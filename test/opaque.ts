@@ -0,0 +1,67 @@
+import { Canvas, Image } from "../mod.ts";
+import { assertEquals } from "./deps.ts";
+
+function pixel(canvas: Canvas, x: number, y: number) {
+  return Array.from(canvas.readPixels(x, y, 1, 1));
+}
+
+// Color type in the IHDR chunk: 2 is RGB, 6 RGBA
+function pngColorType(png: Uint8Array) {
+  return png[25];
+}
+
+function draw(canvas: Canvas) {
+  const ctx = canvas.getContext("2d");
+  for (let i = 0; i < 500; i++) {
+    ctx.fillStyle = `hsl(${i % 360}, 80%, 50%)`;
+    ctx.fillRect((i * 37) % canvas.width, (i * 53) % canvas.height, 20, 10);
+  }
+}
+
+Deno.test("opaque canvases start black and clear to black", () => {
+  const canvas = new Canvas(100, 100);
+  const ctx = canvas.getContext("2d", { alpha: false });
+  assertEquals(pixel(canvas, 50, 50), [0, 0, 0, 255]);
+  ctx.fillStyle = "rgba(255, 255, 255, 0.5)";
+  ctx.fillRect(0, 0, 100, 100);
+  const [r, g, b, a] = pixel(canvas, 50, 50);
+  assertEquals([Math.abs(r - 128) <= 1, r === g && g === b, a], [
+    true,
+    true,
+    255,
+  ]);
+  ctx.clearRect(0, 0, 50, 50);
+  assertEquals(pixel(canvas, 10, 10), [0, 0, 0, 255]);
+
+  const resized = new Canvas(10, 10, { alpha: false });
+  resized.resize(20, 20);
+  assertEquals(pixel(resized, 15, 15), [0, 0, 0, 255]);
+});
+
+Deno.test("alpha only applies to the first getContext call", () => {
+  const canvas = new Canvas(10, 10);
+  canvas.getContext("2d");
+  canvas.getContext("2d", { alpha: false }).clearRect(0, 0, 10, 10);
+  assertEquals(pixel(canvas, 5, 5), [0, 0, 0, 0]);
+});
+
+Deno.test("opaque canvases encode without alpha", () => {
+  // Small enough for Skia's encoder, large enough for the parallel one
+  for (const [width, height] of [[100, 80], [800, 600]]) {
+    const opaque = new Canvas(width, height, { alpha: false });
+    const transparent = new Canvas(width, height);
+    transparent.getContext("2d").fillRect(0, 0, width, height);
+    draw(opaque);
+    draw(transparent);
+    assertEquals(opaque.readPixels(), transparent.readPixels());
+
+    const png = opaque.encode("png");
+    assertEquals(pngColorType(png), 2);
+    assertEquals(pngColorType(transparent.encode("png")), 6);
+    assertEquals(png.length < transparent.encode("png").length, true);
+
+    const decoded = new Canvas(width, height);
+    decoded.getContext("2d").drawImage(new Image(png), 0, 0);
+    assertEquals(decoded.readPixels(), opaque.readPixels());
+  }
+});
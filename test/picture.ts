@@ -0,0 +1,132 @@
+import {
+  Canvas,
+  type CanvasRenderingContext2D,
+  Image,
+  PdfDocument,
+  Picture,
+  PictureRecorder,
+  RenderPool,
+  SvgCanvas,
+} from "../mod.ts";
+import { assertEquals, assertThrows } from "./deps.ts";
+
+function draw(ctx: CanvasRenderingContext2D) {
+  ctx.fillStyle = "#336699";
+  ctx.fillRect(10, 10, 120, 80);
+  ctx.strokeStyle = "orange";
+  ctx.lineWidth = 6;
+  ctx.beginPath();
+  ctx.arc(100, 100, 50, 0, Math.PI * 2);
+  ctx.stroke();
+  ctx.font = "16px sans-serif";
+  ctx.fillStyle = "black";
+  ctx.fillText("Recorded", 20, 180);
+}
+
+function record() {
+  const recorder = new PictureRecorder(200, 200);
+  draw(recorder.getContext("2d"));
+  return recorder.finish();
+}
+
+Deno.test("replaying a picture matches drawing directly", () => {
+  const direct = new Canvas(200, 200);
+  draw(direct.getContext("2d"));
+
+  const picture = record();
+  assertEquals([picture.width, picture.height], [200, 200]);
+  const replayed = new Canvas(200, 200);
+  replayed.getContext("2d").drawPicture(picture);
+
+  assertEquals(replayed.readPixels(), direct.readPixels());
+});
+
+Deno.test("tiled drawing matches drawing in one go", () => {
+  const picture = record();
+  const expected = new Canvas(700, 500);
+  expected.getContext("2d").drawPicture(picture, 0, 0, 700, 500);
+  const tiled = new Canvas(700, 500);
+  tiled.drawPictureTiled(picture, { tileSize: 96, threads: 4 });
+  assertEquals(tiled.readPixels(), expected.readPixels());
+});
+
+Deno.test("rendering to a file in strips matches drawing", () => {
+  const recorder = new PictureRecorder(200, 200);
+  const ctx = recorder.getContext("2d");
+  // Opaque, so the PNG round trip is lossless
+  ctx.fillStyle = "white";
+  ctx.fillRect(0, 0, 200, 200);
+  draw(ctx);
+  const picture = recorder.finish();
+
+  const path = Deno.makeTempFileSync({ suffix: ".png" });
+  Canvas.renderToFile(picture, path, {
+    width: 300,
+    height: 300,
+    stripHeight: 7,
+  });
+  const streamed = new Canvas(300, 300);
+  streamed.getContext("2d").drawImage(Image.loadSync(path), 0, 0);
+  Deno.removeSync(path);
+
+  const expected = new Canvas(300, 300);
+  expected.getContext("2d").drawPicture(picture, 0, 0, 300, 300);
+  assertEquals(streamed.readPixels(), expected.readPixels());
+});
+
+Deno.test("pictures survive serialization", () => {
+  const sprite = new Canvas(32, 32);
+  sprite.getContext("2d").fillRect(8, 8, 16, 16);
+  const recorder = new PictureRecorder(200, 200);
+  const ctx = recorder.getContext("2d");
+  draw(ctx);
+  // Two snapshots of the same pixels are stored once
+  ctx.drawImage(sprite, 140, 10);
+  ctx.drawImage(sprite, 140, 60);
+  const picture = recorder.finish();
+
+  const loaded = Picture.deserialize(picture.serialize());
+  assertEquals([loaded.width, loaded.height], [200, 200]);
+  const expected = new Canvas(200, 200);
+  expected.getContext("2d").drawPicture(picture);
+  const actual = new Canvas(200, 200);
+  actual.getContext("2d").drawPicture(loaded);
+  assertEquals(actual.readPixels(), expected.readPixels());
+});
+
+Deno.test("a picture can be output at several sizes and formats", async () => {
+  const picture = record();
+
+  const large = new Canvas(400, 400);
+  large.getContext("2d").drawPicture(picture, 0, 0, 400, 400);
+  const pool = new RenderPool(2);
+  assertEquals(
+    await pool.renderPicture(picture, 400, 400),
+    large.encode("png"),
+  );
+  await pool.close();
+
+  const pdf = new PdfDocument();
+  pdf.newPage(200, 200).drawPicture(picture);
+  pdf.endPage();
+  assertEquals(pdf.encode().length > 0, true);
+
+  const svg = new SvgCanvas(100, 100);
+  svg.getContext().drawPicture(picture, 0, 0, 100, 100);
+  svg.complete();
+  assertEquals(svg.toString().includes("<path"), true);
+});
+
+Deno.test("the context of a finished recording throws", () => {
+  const recorder = new PictureRecorder(100, 100);
+  const ctx = recorder.getContext("2d");
+  ctx.fillRect(0, 0, 10, 10);
+  recorder.finish();
+
+  assertThrows(() => ctx.fillRect(0, 0, 10, 10));
+  assertThrows(() => ctx.fillText("late", 0, 10));
+  assertThrows(() => ctx.measureText("late"));
+  assertThrows(() => recorder.getContext("2d"));
+  assertThrows(() => recorder.finish());
+  assertEquals(ctx._unsafePointer, null);
+});
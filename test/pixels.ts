@@ -0,0 +1,93 @@
+import { Canvas, Image } from "../mod.ts";
+import { assertEquals, assertThrows } from "./deps.ts";
+
+function canvas() {
+  const canvas = new Canvas(64, 48);
+  const ctx = canvas.getContext("2d");
+  ctx.fillStyle = "#ff0000";
+  ctx.fillRect(0, 0, 64, 48);
+  return canvas;
+}
+
+// Byte offsets of red and blue in a 32-bit pixel
+function channels(colorType: string) {
+  return colorType === "bgra8888" ? [2, 0] : [0, 2];
+}
+
+Deno.test("locked pixels are the canvas pixels", () => {
+  const c = canvas();
+  const pixels = c.lockPixels("read");
+  assertEquals([pixels.width, pixels.height], [64, 48]);
+  assertEquals(pixels.rowBytes >= 64 * 4, true);
+  assertEquals(pixels.alphaType, "premul");
+  assertEquals(pixels.data.length, pixels.rowBytes * 48);
+  const [r, b] = channels(pixels.colorType);
+  const last = pixels.rowBytes * 47 + 63 * 4;
+  assertEquals([pixels.data[last + r], pixels.data[last + b]], [255, 0]);
+  pixels.unlock();
+});
+
+Deno.test("writes through locked pixels are seen afterwards", () => {
+  const c = canvas();
+  c.encode("png");
+  const pixels = c.lockPixels();
+  const [r, b] = channels(pixels.colorType);
+  for (let y = 0; y < pixels.height; y++) {
+    for (let x = 0; x < pixels.width; x++) {
+      const i = y * pixels.rowBytes + x * 4;
+      pixels.data[i + r] = 0;
+      pixels.data[i + b] = 255;
+    }
+  }
+  pixels.unlock();
+
+  const blue = c.getContext("2d").getImageData(0, 0, 64, 48).data;
+  assertEquals(Array.from(blue.subarray(0, 4)), [0, 0, 255, 255]);
+  // The encoded image cache isn't reused
+  const decoded = new Canvas(64, 48);
+  decoded.getContext("2d").drawImage(new Image(c.encode("png")), 0, 0);
+  assertEquals(decoded.readPixels(), c.readPixels());
+  assertEquals(c.encodeCacheStats.hits, 0);
+});
+
+Deno.test("snapshots taken before locking keep their content", async () => {
+  const c = canvas();
+  const expected = c.encode("jpeg", 90);
+  const pending = c.encodeAsync("jpeg", 90);
+  const pixels = c.lockPixels();
+  pixels.data.fill(0);
+  pixels.unlock();
+  assertEquals(await pending, expected);
+});
+
+Deno.test("encoding while locked keeps the locked pixels current", () => {
+  const c = canvas();
+  const pixels = c.lockPixels();
+  const [r, b] = channels(pixels.colorType);
+  c.encode("png");
+  const ctx = c.getContext("2d");
+  ctx.fillStyle = "#0000ff";
+  ctx.fillRect(0, 0, 64, 48);
+  // Flushes the fill, which must draw into the locked pixels rather than
+  // into a copy made for the encoded snapshot
+  c.readPixels(0, 0, 1, 1);
+  assertEquals([pixels.data[r], pixels.data[b]], [0, 255]);
+  pixels.data[r] = 255;
+  pixels.data[b] = 0;
+  assertEquals(Array.from(c.readPixels(0, 0, 1, 1)), [255, 0, 0, 255]);
+  // Images encoded while locked aren't reused, writes don't invalidate them
+  c.encode("png");
+  pixels.unlock();
+  assertEquals(c.encodeCacheStats.hits, 0);
+});
+
+Deno.test("only one lock at a time, no resizing while locked", () => {
+  const c = canvas();
+  const pixels = c.lockPixels();
+  assertThrows(() => c.lockPixels());
+  assertThrows(() => c.resize(10, 10));
+  pixels.unlock();
+  pixels.unlock();
+  c.lockPixels("read").unlock();
+  c.resize(10, 10);
+});
@@ -0,0 +1,48 @@
+import { Canvas, Image } from "../mod.ts";
+import { assertEquals } from "./deps.ts";
+
+// Tall enough to be split into several strips
+function canvas() {
+  const canvas = new Canvas(1200, 900);
+  const ctx = canvas.getContext("2d");
+  for (let i = 0; i < 3000; i++) {
+    ctx.fillStyle = `hsl(${i % 360}, 80%, ${30 + (i % 40)}%)`;
+    ctx.fillRect((i * 37) % 1200, (i * 53) % 900, 3 + (i % 17), 3 + (i % 13));
+  }
+  // Fully transparent pixels survive the round trip exactly too
+  ctx.clearRect(100, 200, 300, 400);
+  return canvas;
+}
+
+function decode(bytes: Uint8Array, width: number, height: number) {
+  const decoded = new Canvas(width, height);
+  decoded.getContext("2d").drawImage(new Image(bytes), 0, 0);
+  return decoded.readPixels();
+}
+
+Deno.test("parallel PNG encoding round-trips through Skia's decoder", () => {
+  const c = canvas();
+  const threads = Canvas.pngEncoderThreads;
+  Canvas.encodeCacheEnabled = false;
+  try {
+    for (const n of [0, 1, 4]) {
+      Canvas.pngEncoderThreads = n;
+      const png = c.encode("png");
+      assertEquals(Array.from(png.subarray(1, 4)), [80, 78, 71]);
+      assertEquals(decode(png, 1200, 900), c.readPixels());
+    }
+  } finally {
+    Canvas.pngEncoderThreads = threads;
+    Canvas.encodeCacheEnabled = true;
+  }
+});
+
+Deno.test("parallel PNG encoding handles small and odd sized images", () => {
+  for (const [width, height] of [[1, 1], [1, 3000], [333, 777]]) {
+    const c = new Canvas(width, height);
+    const ctx = c.getContext("2d");
+    ctx.fillStyle = "#123456";
+    ctx.fillRect(0, 0, width, height / 2);
+    assertEquals(decode(c.encode("png"), width, height), c.readPixels());
+  }
+});
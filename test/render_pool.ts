@@ -0,0 +1,32 @@
+import { Canvas, CommandBuffer, Op, RenderPool } from "../mod.ts";
+import ffi from "../src/ffi.ts";
+import { assertEquals } from "./deps.ts";
+
+const { sk_context_execute } = ffi;
+
+function drawing(seed: number) {
+  const cmd = new CommandBuffer();
+  cmd.pushString(Op.SetFillStyle, `hsl(${seed * 40}, 80%, 50%)`);
+  cmd.push4(Op.FillRect, seed, seed, 100, 60);
+  cmd.push1(Op.SetLineWidth, 4);
+  cmd.push0(Op.BeginPath);
+  cmd.push6(Op.Arc, 120, 120, 40 + seed, 0, Math.PI * 2, 0);
+  cmd.push0(Op.Stroke);
+  cmd.pushText(Op.FillText, `Chart ${seed}`, 20, 180, 100_000);
+  return cmd.take();
+}
+
+Deno.test("render pool matches drawing on a canvas", async () => {
+  const pool = new RenderPool(4);
+  const drawings = Array.from({ length: 16 }, (_, i) => drawing(i));
+  const rendered = await Promise.all(
+    drawings.map((ops) => pool.render(200, 200, ops)),
+  );
+  await pool.close();
+
+  drawings.forEach((ops, i) => {
+    const canvas = new Canvas(200, 200);
+    sk_context_execute(canvas.getContext("2d")._unsafePointer, ops, ops.length);
+    assertEquals(rendered[i], canvas.encode("png"));
+  });
+});
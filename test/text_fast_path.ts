@@ -0,0 +1,40 @@
+import { Canvas, type TextAlign, type TextBaseline } from "../mod.ts";
+import ffi from "../src/ffi.ts";
+import { assertEquals } from "./deps.ts";
+
+const { sk_text_set_fast_path } = ffi;
+
+const LABELS = ["0", "42", "Hello, world!", "AVATAR Wolf", "café à la crème"];
+const FONTS = ["10px sans-serif", "bold 16px serif", "italic 24px monospace"];
+const BASELINES: TextBaseline[] = ["alphabetic", "top", "middle"];
+const ALIGNS: TextAlign[] = ["left", "center", "right"];
+
+function render(fastPath: boolean) {
+  sk_text_set_fast_path(fastPath ? 1 : 0);
+  const canvas = new Canvas(400, 400);
+  const ctx = canvas.getContext("2d");
+  const metrics = [];
+  let i = 0;
+  let y = 20;
+  for (const font of FONTS) {
+    ctx.font = font;
+    for (const label of LABELS) {
+      // Walks through every baseline and alignment combination
+      ctx.textBaseline = BASELINES[i % BASELINES.length];
+      ctx.textAlign = ALIGNS[Math.floor(i / BASELINES.length) % ALIGNS.length];
+      ctx.fillText(label, 200, y);
+      ctx.strokeText(label, 200, y);
+      metrics.push(ctx.measureText(label));
+      y += 24;
+      i++;
+    }
+  }
+  return { pixels: canvas.readPixels(), metrics };
+}
+
+Deno.test("simple text fast path matches skparagraph", () => {
+  const paragraph = render(false);
+  const fast = render(true);
+  assertEquals(fast.metrics, paragraph.metrics);
+  assertEquals(fast.pixels, paragraph.pixels);
+});
@@ -0,0 +1,38 @@
+import { Fonts } from "../mod.ts";
+import { assertEquals } from "./deps.ts";
+
+const WORKERS = 8;
+const FAMILIES = Fonts.families;
+
+Deno.test({
+  name: "drawing text on 8 workers while registering fonts",
+  // Aliases need a registered family to point to
+  ignore: FAMILIES.length === 0,
+}, async () => {
+  const url = new URL("./threads_worker.ts", import.meta.url);
+  const results = Array.from({ length: WORKERS }, (_, id) => {
+    const worker = new Worker(url, { type: "module" });
+    return new Promise<number>((resolve, reject) => {
+      worker.onmessage = (e) => {
+        worker.terminate();
+        resolve(e.data);
+      };
+      worker.onerror = (e) => {
+        worker.terminate();
+        reject(e);
+      };
+      worker.postMessage(id);
+    });
+  });
+
+  let done = false;
+  Promise.allSettled(results).then(() => done = true);
+  for (let i = 0; !done; i++) {
+    // Every registration replaces the font collections and clears the text
+    // caches of all workers
+    Fonts.setAlias(`Stress ${i}`, FAMILIES[i % FAMILIES.length]);
+    await new Promise((resolve) => setTimeout(resolve, 1));
+  }
+
+  assertEquals(await Promise.all(results), new Array(WORKERS).fill(200));
+});
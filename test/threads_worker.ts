@@ -0,0 +1,19 @@
+/// <reference lib="deno.worker" />
+import { createCanvas } from "../mod.ts";
+
+const FONTS = ["10px sans-serif", "bold 16px serif", "italic 12px monospace"];
+
+self.onmessage = (e) => {
+  const id = e.data as number;
+  const canvas = createCanvas(256, 256);
+  const ctx = canvas.getContext("2d");
+  let drawn = 0;
+  for (let i = 0; i < 200; i++) {
+    ctx.font = FONTS[(id + i) % FONTS.length];
+    ctx.fillText(`Worker ${id} label ${i % 20}`, 10, 10 + (i % 24) * 10);
+    ctx.strokeText("héllo wörld", 10, 200);
+    if (ctx.measureText(`${i}`).width > 0) drawn++;
+  }
+  canvas.readPixels(0, 0, 1, 1);
+  self.postMessage(drawn);
+};